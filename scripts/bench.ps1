@@ -0,0 +1,3 @@
+make bench
+./bench.exe $args > bench.json
+cat bench.json
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+set -e
+
+make bench
+./bench.exe "$@" > bench.json
+cat bench.json
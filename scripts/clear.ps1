@@ -5,3 +5,4 @@ rm -Force -erroraction 'silentlycontinue' ./test/*.o
 rm -Force -erroraction 'silentlycontinue' ./test.exe
 rm -Force -erroraction 'silentlycontinue' ./rc_test.exe
 rm -Force -erroraction 'silentlycontinue' ./perf_test.exe
+rm -Force -erroraction 'silentlycontinue' ./bench.exe
@@ -7,3 +7,4 @@ rm -f ./test/*.o
 rm -f ./test.exe
 rm -f ./rc_test.exe
 rm -f ./perf_test.exe
+rm -f ./bench.exe
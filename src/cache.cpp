@@ -6,7 +6,9 @@ namespace forest{
 namespace details{
 	
 	namespace cache{
-		mutex tree_cache_m, leaf_cache_m, intr_cache_m;
+		profiled_mutex tree_cache_m(LOCK_CLASS::TREE_CACHE);
+		profiled_mutex leaf_cache_m(LOCK_CLASS::LEAF_CACHE);
+		profiled_mutex intr_cache_m(LOCK_CLASS::INTR_CACHE);
 		std::unordered_map<string, tree_cache_ref_t*> tree_cache_r;
 		std::unordered_map<string, node_cache_ref_t*> leaf_cache_r;
 		std::unordered_map<string, node_cache_ref_t*> intr_cache_r;
@@ -305,6 +307,23 @@ void forest::details::cache::with_lock(NODE_TYPES type, std::function<void()> fn
 }
 
 
+std::vector<forest::details::node_ptr> forest::details::cache::get_hot_nodes(NODE_TYPES type)
+{
+	// Most recently used first
+	if(type == NODE_TYPES::INTR){
+		auto lock = get_intr_lock();
+		return std::vector<node_ptr>(intr_cache_l.begin(), intr_cache_l.end());
+	}
+	auto lock = get_leaf_lock();
+	return std::vector<node_ptr>(leaf_cache_l.begin(), leaf_cache_l.end());
+}
+
+std::vector<forest::details::tree_ptr> forest::details::cache::get_hot_trees()
+{
+	auto lock = tree_cache_m.hold();
+	return std::vector<tree_ptr>(tree_cache_l.begin(), tree_cache_l.end());
+}
+
 void forest::details::cache::intr_insert(tree_t::node_ptr& node, bool w_lock)
 {
 	if(w_lock){
@@ -8,6 +8,7 @@
 #include "node_data.hpp"
 #include "savior.hpp"
 #include "tree.hpp"
+#include "lock_profiler.hpp"
 
 namespace forest{
 namespace details{
@@ -52,14 +53,14 @@ namespace details{
 		void intr_cache_clear();
 		void tree_cache_clear();
 		
-		void intr_lock();
+		void intr_lock(const char* site = __builtin_FUNCTION());
 		void intr_unlock();
-		void leaf_lock();
+		void leaf_lock(const char* site = __builtin_FUNCTION());
 		void leaf_unlock();
-		void tree_lock();
+		void tree_lock(const char* site = __builtin_FUNCTION());
 		void tree_unlock();
-		std::lock_guard<mutex> get_intr_lock();
-		std::lock_guard<mutex> get_leaf_lock();
+		std::unique_lock<profiled_mutex> get_intr_lock(const char* site = __builtin_FUNCTION());
+		std::unique_lock<profiled_mutex> get_leaf_lock(const char* site = __builtin_FUNCTION());
 		
 		void reserve_node(tree_t::node_ptr& node, bool w_lock=false);
 		void release_node(tree_t::node_ptr& node, bool w_lock=false);
@@ -75,12 +76,15 @@ namespace details{
 		
 		void with_lock(NODE_TYPES type, std::function<void()> fn);
 		
+		std::vector<node_ptr> get_hot_nodes(NODE_TYPES type);
+		std::vector<tree_ptr> get_hot_trees();
+		
 		void clear_node_cache(tree_t::node_ptr& node);
 		
 		void _intr_insert(tree_t::node_ptr& node);
 		void _leaf_insert(tree_t::node_ptr& node);
 		
-		extern mutex tree_cache_m, leaf_cache_m, intr_cache_m;
+		extern profiled_mutex tree_cache_m, leaf_cache_m, intr_cache_m;
 		extern std::unordered_map<string, tree_cache_ref_t*> tree_cache_r;
 		extern std::unordered_map<string, node_cache_ref_t*> leaf_cache_r;
 		extern std::unordered_map<string, node_cache_ref_t*> intr_cache_r;
@@ -108,9 +112,9 @@ inline void forest::details::cache::remove_item(tree_t::child_item_type_ptr& ite
 	--item->item->second->res_c;
 }
 
-inline void forest::details::cache::intr_lock()
+inline void forest::details::cache::intr_lock(const char* site)
 {
-	intr_cache_m.lock();
+	intr_cache_m.lock(site);
 }
 
 inline void forest::details::cache::intr_unlock()
@@ -118,14 +122,14 @@ inline void forest::details::cache::intr_unlock()
 	intr_cache_m.unlock();
 }
 
-inline void forest::details::cache::leaf_lock()
+inline void forest::details::cache::leaf_lock(const char* site)
 {
-	leaf_cache_m.lock();
+	leaf_cache_m.lock(site);
 }
 
-inline void forest::details::cache::tree_lock()
+inline void forest::details::cache::tree_lock(const char* site)
 {
-	tree_cache_m.lock();
+	tree_cache_m.lock(site);
 }
 
 inline void forest::details::cache::tree_unlock()
@@ -133,14 +137,14 @@ inline void forest::details::cache::tree_unlock()
 	tree_cache_m.unlock();
 }
 
-inline std::lock_guard<std::mutex> forest::details::cache::get_intr_lock()
+inline std::unique_lock<forest::details::profiled_mutex> forest::details::cache::get_intr_lock(const char* site)
 {
-	return std::lock_guard<std::mutex>(intr_cache_m);
+	return intr_cache_m.hold(site);
 }
 
-inline std::lock_guard<std::mutex> forest::details::cache::get_leaf_lock()
+inline std::unique_lock<forest::details::profiled_mutex> forest::details::cache::get_leaf_lock(const char* site)
 {
-	return std::lock_guard<std::mutex>(leaf_cache_m);
+	return leaf_cache_m.hold(site);
 }
 
 inline void forest::details::cache::reserve_intr_node(node_ptr node, int cnt)
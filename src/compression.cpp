@@ -0,0 +1,120 @@
+#include "compression.hpp"
+#include "dictionary.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Contexts are expensive to create, so keep one per thread
+	struct compress_ctx_t{
+		ZSTD_CCtx* ctx = ZSTD_createCCtx();
+		~compress_ctx_t(){ ZSTD_freeCCtx(ctx); }
+	};
+	thread_local compress_ctx_t compress_ctx;
+	
+} // details
+} // forest
+
+
+forest::details::string forest::details::compress_block(const char* data, uint_t size)
+{
+	string out(ZSTD_compressBound(size), '\0');
+	size_t res = ZSTD_compressCCtx(compress_ctx.ctx, &out[0], out.size(), data, size, COMPRESSION_LEVEL);
+	if(ZSTD_isError(res)){
+		L_ERR("[compress_block]-(" + string(ZSTD_getErrorName(res)) + ")");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	out.resize(res);
+	return out;
+}
+
+forest::details::string forest::details::decompress_block(const char* data, uint_t size, uint_t raw_size)
+{
+	string out(raw_size, '\0');
+	size_t res = ZSTD_decompress(&out[0], raw_size, data, size);
+	if(ZSTD_isError(res) || res != raw_size){
+		L_ERR("[decompress_block]-(corrupted block)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	return out;
+}
+
+forest::details::uint_t forest::details::compress_value(tree_t::val_type& data, char* buf, int buf_size, compress_sink_t sink, ZSTD_CDict* dict)
+{
+	ZSTD_CCtx* ctx = compress_ctx.ctx;
+	ZSTD_CCtx_reset(ctx, ZSTD_reset_session_only);
+	ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, COMPRESSION_LEVEL);
+	ZSTD_CCtx_refCDict(ctx, dict);
+	
+	std::vector<char> out(ZSTD_CStreamOutSize());
+	uint_t packed = 0;
+	auto reader = data->get_reader();
+	
+	while(true){
+		uint_t rsz = reader.read(buf, buf_size);
+		ZSTD_EndDirective mode = rsz ? ZSTD_e_continue : ZSTD_e_end;
+		ZSTD_inBuffer zin = {buf, rsz, 0};
+		size_t left;
+		do{
+			ZSTD_outBuffer zout = {out.data(), out.size(), 0};
+			left = ZSTD_compressStream2(ctx, &zout, &zin, mode);
+			if(ZSTD_isError(left)){
+				L_ERR("[compress_value]-(" + string(ZSTD_getErrorName(left)) + ")");
+				throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+			}
+			sink(out.data(), zout.pos);
+			packed += zout.pos;
+		} while(mode == ZSTD_e_end ? left != 0 : zin.pos < zin.size);
+		
+		if(!rsz){
+			break;
+		}
+	}
+	
+	return packed;
+}
+
+
+// Decompression state
+forest::details::decompress_state::decompress_state() : ctx(ZSTD_createDCtx()), in(ZSTD_DStreamInSize())
+{
+	zin = {in.data(), 0, 0};
+}
+
+forest::details::decompress_state::~decompress_state()
+{
+	ZSTD_freeDCtx(ctx);
+}
+
+void forest::details::decompress_state::read(file_data_t* data, char* buffer, uint_t count)
+{
+	// Decompress straight into the caller buffer
+	ZSTD_outBuffer zout = {buffer, count, 0};
+	while(zout.pos < zout.size){
+		if(zin.pos == zin.size){
+			uint_t sz = std::min((uint_t)in.size(), data->get_packed() - consumed);
+			if(!sz){
+				L_ERR("[decompress_state::read]-(unexpected end of value)");
+				throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+			}
+			{
+				auto lock = data->file->get_lock();
+				data->file->seekg(data->get_start() + consumed);
+				data->file->read(in.data(), sz);
+			}
+			if(!consumed){
+				// Frame header names the dictionary value was packed with
+				unsigned id = ZSTD_getDictID_fromFrame(in.data(), sz);
+				if(id){
+					ZSTD_DCtx_refDDict(ctx, dictionaries->get_ddict(id));
+				}
+			}
+			consumed += sz;
+			zin = {in.data(), sz, 0};
+		}
+		size_t res = ZSTD_decompressStream(ctx, &zout, &zin);
+		if(ZSTD_isError(res)){
+			L_ERR("[decompress_state::read]-(" + string(ZSTD_getErrorName(res)) + ")");
+			throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+		}
+	}
+}
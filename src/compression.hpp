@@ -0,0 +1,39 @@
+#ifndef FOREST_COMPRESSION_H
+#define FOREST_COMPRESSION_H
+
+#include <vector>
+#include <zstd.h>
+#include "dbutils.hpp"
+
+namespace forest{
+namespace details{
+	
+	extern int COMPRESSION_LEVEL;
+	extern int COMPRESS_VALUE_BYTES;
+	
+	using compress_sink_t = std::function<void(const char*, uint_t)>;
+	
+	// Block compression of leaf key sections
+	string compress_block(const char* data, uint_t size);
+	string decompress_block(const char* data, uint_t size, uint_t raw_size);
+	
+	// Streams raw value through zstd into the sink, returns packed size
+	uint_t compress_value(tree_t::val_type& data, char* buf, int buf_size, compress_sink_t sink, ZSTD_CDict* dict = nullptr);
+	
+	// Decompression state of a single packed value reader
+	struct decompress_state{
+		decompress_state();
+		~decompress_state();
+		void read(file_data_t* data, char* buffer, uint_t count);
+		
+		private:
+			ZSTD_DCtx* ctx;
+			std::vector<char> in;
+			ZSTD_inBuffer zin;
+			uint_t consumed = 0;
+	};
+	
+} // details
+} // forest
+
+#endif // FOREST_COMPRESSION_H
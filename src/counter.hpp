@@ -0,0 +1,71 @@
+#ifndef FOREST_COUNTER_H
+#define FOREST_COUNTER_H
+
+#include <atomic>
+#include <thread>
+#include <functional>
+#include "dbutils.hpp"
+
+namespace forest{
+namespace details{
+
+	// Counter split into cache line sized shards to not make
+	// concurrent writers fight for the same atomic
+	class sharded_counter{
+
+		static const int SHARDS = 16;
+
+		struct alignas(64) shard_t{
+			std::atomic<int_t> v = 0;
+		};
+
+		public:
+			void add(int_t v);
+			void sub(int_t v);
+			void set(int_t v);
+			int_t get();
+
+		private:
+			static int shard_index();
+
+			shard_t shards[SHARDS];
+	};
+
+} // details
+} // forest
+
+
+inline void forest::details::sharded_counter::add(int_t v)
+{
+	shards[shard_index()].v.fetch_add(v, std::memory_order_relaxed);
+}
+
+inline void forest::details::sharded_counter::sub(int_t v)
+{
+	shards[shard_index()].v.fetch_sub(v, std::memory_order_relaxed);
+}
+
+inline void forest::details::sharded_counter::set(int_t v)
+{
+	shards[0].v.store(v, std::memory_order_relaxed);
+	for(int i=1;i<SHARDS;i++){
+		shards[i].v.store(0, std::memory_order_relaxed);
+	}
+}
+
+inline forest::details::int_t forest::details::sharded_counter::get()
+{
+	int_t sum = 0;
+	for(int i=0;i<SHARDS;i++){
+		sum += shards[i].v.load(std::memory_order_relaxed);
+	}
+	return sum;
+}
+
+inline int forest::details::sharded_counter::shard_index()
+{
+	thread_local int index = std::hash<std::thread::id>()(std::this_thread::get_id()) % SHARDS;
+	return index;
+}
+
+#endif // FOREST_COUNTER_H
@@ -0,0 +1,69 @@
+#include "crc32c.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FOREST_CRC32C_HW
+#include <nmmintrin.h>
+#endif
+
+namespace forest{
+namespace details{
+	
+	struct crc32c_table_t{
+		uint32_t t[256];
+		crc32c_table_t(){
+			for(uint32_t i=0;i<256;i++){
+				uint32_t c = i;
+				for(int k=0;k<8;k++){
+					c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+				}
+				t[i] = c;
+			}
+		}
+	};
+	
+	static uint32_t crc32c_sw(uint32_t crc, const unsigned char* p, uint_t size)
+	{
+		static const crc32c_table_t table;
+		while(size--){
+			crc = table.t[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		}
+		return crc;
+	}
+	
+#ifdef FOREST_CRC32C_HW
+	__attribute__((target("sse4.2")))
+	static uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, uint_t size)
+	{
+		uint64_t c = crc;
+		while(size >= 8){
+			uint64_t v;
+			std::memcpy(&v, p, 8);
+			c = _mm_crc32_u64(c, v);
+			p += 8;
+			size -= 8;
+		}
+		crc = (uint32_t)c;
+		while(size--){
+			crc = _mm_crc32_u8(crc, *p++);
+		}
+		return crc;
+	}
+	
+	static const bool crc32c_has_hw = __builtin_cpu_supports("sse4.2");
+#endif
+	
+} // details
+} // forest
+
+
+uint32_t forest::details::crc32c(uint32_t crc, const char* data, uint_t size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	crc = ~crc;
+#ifdef FOREST_CRC32C_HW
+	if(crc32c_has_hw){
+		return ~crc32c_hw(crc, p, size);
+	}
+#endif
+	return ~crc32c_sw(crc, p, size);
+}
@@ -0,0 +1,29 @@
+#ifndef FOREST_CRC32C_H
+#define FOREST_CRC32C_H
+
+#include "dbutils.hpp"
+
+namespace forest{
+namespace details{
+	
+	// CRC32C (Castagnoli) of the data, continues from the given crc.
+	// Uses SSE4.2 crc32 instruction when the processor supports it.
+	uint32_t crc32c(uint32_t crc, const char* data, uint_t size);
+	uint32_t crc32c(uint32_t crc, const string& data);
+	uint32_t crc32c(const string& data);
+	
+} // details
+} // forest
+
+
+inline uint32_t forest::details::crc32c(uint32_t crc, const string& data)
+{
+	return crc32c(crc, data.data(), data.size());
+}
+
+inline uint32_t forest::details::crc32c(const string& data)
+{
+	return crc32c(0, data.data(), data.size());
+}
+
+#endif // FOREST_CRC32C_H
@@ -19,7 +19,8 @@ namespace forest{
 				CANNOT_WRITE_FILE,
 				FOREST_FOLDED,
 				ACCESSING_END_LEAF,
-				BAD_INPUT_PARAMETER
+				BAD_INPUT_PARAMETER,
+				WRITE_STALLED
 			};
 			
 			TreeException(ERRORS code)
@@ -33,7 +34,7 @@ namespace forest{
 			
 		private:
 			std::string msg;
-			static inline const std::string error_messages[11] = {
+			static inline const std::string error_messages[12] = {
 				"Cannot create root files",
 				"Cannot create files",
 				"Not valid tree type",
@@ -44,7 +45,8 @@ namespace forest{
 				"Cannot write to file",
 				"Forest Folded",
 				"Trying to access End leaf data",
-				"Inconvinient input parameter provided"
+				"Inconvinient input parameter provided",
+				"Writes are stalled until saves catch up"
 			};  
 	};
 }
@@ -67,6 +67,19 @@ forest::details::string forest::details::read_leaf_item(file_data_ptr item)
 	return ret;
 }
 
+bool forest::details::same_leaf_value(file_data_ptr a, file_data_ptr b)
+{
+	if(a == b){
+		return true;
+	}
+	
+	// Values are read again when their leaf is loaded back to the cache
+	if(!a || !b || a->size() != b->size()){
+		return false;
+	}
+	return read_leaf_item(a) == read_leaf_item(b);
+}
+
 void forest::details::opened_files_inc()
 {
 	std::unique_lock<std::mutex> flock(opened_files_m);
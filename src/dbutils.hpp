@@ -40,6 +40,7 @@ namespace details{
 	file_data_ptr extract_leaf_val(detached_leaf_ptr dl);
 	string to_string(int num);
 	string read_leaf_item(file_data_ptr item);
+	bool same_leaf_value(file_data_ptr a, file_data_ptr b);
 	
 	// Files manager methods
 	void opened_files_inc();
@@ -0,0 +1,252 @@
+#include "dictionary.hpp"
+#include <zdict.h>
+
+
+forest::details::Dictionaries::Dictionaries()
+{
+	// ctor
+}
+
+forest::details::Dictionaries::~Dictionaries()
+{
+	trainer.wait();
+	
+	for(auto& it : dicts){
+		ZSTD_freeCDict(it.second->cdict);
+		ZSTD_freeDDict(it.second->ddict);
+		delete it.second;
+	}
+}
+
+forest::details::uint_t forest::details::Dictionaries::train(std::vector<string>& samples)
+{
+	string joined;
+	std::vector<size_t> sizes;
+	for(auto& s : samples){
+		joined.append(s);
+		sizes.push_back(s.size());
+	}
+	
+	string dict(DICT_BYTES, '\0');
+	size_t res = ZDICT_trainFromBuffer(&dict[0], dict.size(), joined.data(), sizes.data(), sizes.size());
+	if(ZDICT_isError(res)){
+		// Not enough samples is not an error of the tree itself
+		L_ERR("[Dictionaries::train]-(" + string(ZDICT_getErrorName(res)) + ")");
+		return 0;
+	}
+	dict.resize(res);
+	
+	uint_t id = ZDICT_getDictID(dict.data(), dict.size());
+	if(!id){
+		return 0;
+	}
+	
+	// Ratio reached on the samples, later ratio is compared to it
+	dict_t* d = create(dict.data(), dict.size(), 0);
+	ZSTD_CCtx* ctx = ZSTD_createCCtx();
+	uint_t packed = 0;
+	string out;
+	for(auto& s : samples){
+		out.resize(ZSTD_compressBound(s.size()));
+		size_t sz = ZSTD_compress_usingCDict(ctx, &out[0], out.size(), s.data(), s.size(), d->cdict);
+		packed += ZSTD_isError(sz) ? s.size() : sz;
+	}
+	ZSTD_freeCCtx(ctx);
+	d->ratio = packed ? (double)joined.size() / packed : 0;
+	
+	DBFS::File* f = DBFS::create();
+	f->write(std::to_string(d->ratio) + " " + std::to_string(dict.size()) + "\n");
+	f->write(dict.data(), dict.size());
+	
+	bool fail = f->fail();
+	string new_name = f->name();
+	delete f;
+	
+	if(fail){
+		L_ERR("[Dictionaries::train]-(cannot write file)");
+		ZSTD_freeCDict(d->cdict);
+		ZSTD_freeDDict(d->ddict);
+		delete d;
+		DBFS::remove(new_name);
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	
+	std::lock_guard<mutex> lock(mtx);
+	if(dicts.count(id)){
+		// The same samples gave the same dictionary
+		ZSTD_freeCDict(d->cdict);
+		ZSTD_freeDDict(d->ddict);
+		delete d;
+		DBFS::remove(new_name);
+	} else {
+		DBFS::move(new_name, dict_name(id));
+		dicts[id] = d;
+	}
+	write_refs(id, read_refs(id) + 1);
+	
+	return id;
+}
+
+ZSTD_CDict* forest::details::Dictionaries::get_cdict(uint_t id)
+{
+	return get(id)->cdict;
+}
+
+ZSTD_DDict* forest::details::Dictionaries::get_ddict(uint_t id)
+{
+	return get(id)->ddict;
+}
+
+void forest::details::Dictionaries::account(uint_t id, uint_t raw, uint_t packed)
+{
+	dict_t* d = get(id);
+	d->raw += raw;
+	d->packed += packed;
+	d->values++;
+}
+
+bool forest::details::Dictionaries::degraded(uint_t id)
+{
+	// Ratio of a few values says nothing about the whole tree
+	dict_t* d = get(id);
+	uint_t raw = d->raw, packed = d->packed;
+	if(raw < (uint_t)DICT_REBUILD_BYTES || d->values < (uint_t)DICT_REBUILD_VALUES || !packed){
+		return false;
+	}
+	return (double)raw / packed < d->ratio * DICT_REBUILD_RATIO;
+}
+
+void forest::details::Dictionaries::reset(uint_t id)
+{
+	// Values packed before the rebuild are not compared again
+	dict_t* d = get(id);
+	d->raw = 0;
+	d->packed = 0;
+	d->values = 0;
+}
+
+void forest::details::Dictionaries::release(uint_t id)
+{
+	// Dictionary stays loaded, values read right now may still need it
+	std::lock_guard<mutex> lock(mtx);
+	uint_t refs = read_refs(id);
+	if(refs > 1){
+		write_refs(id, refs - 1);
+		return;
+	}
+	
+	string name = dict_name(id);
+	if(DBFS::exists(name)){
+		DBFS::remove(name);
+	}
+	if(DBFS::exists(refs_name(id))){
+		DBFS::remove(refs_name(id));
+	}
+}
+
+void forest::details::Dictionaries::schedule(std::function<void()> fn)
+{
+	trainer.work(fn);
+}
+
+void forest::details::Dictionaries::wait()
+{
+	trainer.wait();
+}
+
+forest::details::Dictionaries::dict_t* forest::details::Dictionaries::get(uint_t id)
+{
+	std::lock_guard<mutex> lock(mtx);
+	auto it = dicts.find(id);
+	if(it != dicts.end()){
+		return it->second;
+	}
+	return dicts[id] = load(id);
+}
+
+forest::details::Dictionaries::dict_t* forest::details::Dictionaries::load(uint_t id)
+{
+	string name = dict_name(id);
+	if(!DBFS::exists(name)){
+		L_ERR("[Dictionaries::load]-(dictionary does not exist)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	
+	DBFS::File* f = new DBFS::File(name);
+	double ratio;
+	uint_t size;
+	f->read(ratio);
+	f->read(size);
+	f->stream().get();
+	
+	string dict(size, '\0');
+	f->read(&dict[0], size);
+	
+	bool fail = f->fail();
+	delete f;
+	
+	if(fail){
+		L_ERR("[Dictionaries::load]-(cannot read file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	
+	return create(dict.data(), size, ratio);
+}
+
+forest::details::Dictionaries::dict_t* forest::details::Dictionaries::create(const char* data, uint_t size, double ratio)
+{
+	dict_t* d = new dict_t();
+	d->cdict = ZSTD_createCDict(data, size, COMPRESSION_LEVEL);
+	d->ddict = ZSTD_createDDict(data, size);
+	d->ratio = ratio;
+	return d;
+}
+
+forest::details::string forest::details::Dictionaries::dict_name(uint_t id)
+{
+	return DICT_FILE + std::to_string(id);
+}
+
+forest::details::string forest::details::Dictionaries::refs_name(uint_t id)
+{
+	return dict_name(id) + "_refs";
+}
+
+forest::details::uint_t forest::details::Dictionaries::read_refs(uint_t id)
+{
+	string name = refs_name(id);
+	if(!DBFS::exists(name)){
+		return 0;
+	}
+	
+	DBFS::File* f = new DBFS::File(name);
+	uint_t refs = 0;
+	f->read(refs);
+	bool fail = f->fail();
+	delete f;
+	
+	if(fail){
+		L_ERR("[Dictionaries::read_refs]-(cannot read file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	return refs;
+}
+
+void forest::details::Dictionaries::write_refs(uint_t id, uint_t refs)
+{
+	DBFS::File* f = DBFS::create();
+	f->write(std::to_string(refs) + "\n");
+	
+	bool fail = f->fail();
+	string new_name = f->name();
+	delete f;
+	
+	if(fail){
+		L_ERR("[Dictionaries::write_refs]-(cannot write file)");
+		DBFS::remove(new_name);
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	
+	// Count is replaced at once, so it is never lost in between
+	DBFS::move(new_name, refs_name(id));
+}
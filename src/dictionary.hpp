@@ -0,0 +1,60 @@
+#ifndef FOREST_DICTIONARY_H
+#define FOREST_DICTIONARY_H
+
+#include <map>
+#include <vector>
+#include <zstd.h>
+#include "dbutils.hpp"
+#include "variables.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Zstd dictionaries trained from values of compressed trees.
+	// Packed values name their dictionary in the frame header, so
+	// dictionaries are kept by id and loaded from files on demand.
+	// Trees can end up with the same dictionary, so every file keeps
+	// the count of trees using it and is removed when it drops to zero.
+	class Dictionaries{
+		
+		struct dict_t{
+			ZSTD_CDict* cdict = nullptr;
+			ZSTD_DDict* ddict = nullptr;
+			double ratio = 0;
+			std::atomic<uint_t> raw = 0, packed = 0, values = 0;
+		};
+		
+		public:
+			Dictionaries();
+			virtual ~Dictionaries();
+			// Returned dictionary is referenced once by the caller
+			uint_t train(std::vector<string>& samples);
+			ZSTD_CDict* get_cdict(uint_t id);
+			ZSTD_DDict* get_ddict(uint_t id);
+			void account(uint_t id, uint_t raw, uint_t packed);
+			bool degraded(uint_t id);
+			void reset(uint_t id);
+			void release(uint_t id);
+			void schedule(std::function<void()> fn);
+			void wait();
+			
+		private:
+			dict_t* get(uint_t id);
+			dict_t* load(uint_t id);
+			dict_t* create(const char* data, uint_t size, double ratio);
+			string dict_name(uint_t id);
+			string refs_name(uint_t id);
+			uint_t read_refs(uint_t id);
+			void write_refs(uint_t id, uint_t refs);
+			
+			std::map<uint_t, dict_t*> dicts;
+			mutex mtx;
+			Thread_worker trainer{Thread_pool::PRIORITY::COMPACTION};
+	};
+	
+	extern Dictionaries* dictionaries;
+	
+} // details
+} // forest
+
+#endif // FOREST_DICTIONARY_H
@@ -1,4 +1,10 @@
 #include "file_data.hpp"
+#include "value_cache.hpp"
+#include "metrics.hpp"
+#include "compression.hpp"
+#include "crc32c.hpp"
+#include "io_scheduler.hpp"
+#include "variables.hpp"
 
 forest::details::file_data_t::file_data_t(file_ptr file, uint_t start, uint_t length) : file(file), start(start), length(length) {
 	// ctor
@@ -8,16 +14,38 @@ forest::details::file_data_t::file_data_t(const char* data, uint_t length) : sta
 	data_cached = new char[length]; 
 	std::memcpy(data_cached, data, length); 
 	cached = true; 
+	if(VALUE_CHECKSUMS){
+		checksum = crc32c(0, data, length);
+	}
+}
+
+forest::details::file_data_t::file_data_t(file_data_ptr base, merge_operator_ptr op, string delta) : start(0), length(0), base(base), op(op), delta(std::move(delta)) {
+	pending = true;
+	depth = base && base->pending ? base->depth + 1 : 1;
+	counted = (base ? base->counted_size() : 0) + this->delta.size();
+	
+	// Long chains are folded at once, so reads stay cheap for hot keys
+	if(depth >= MERGE_CHAIN_LENGTH){
+		fold();
+	}
 }
 
 forest::details::file_data_t::~file_data_t() { 
+	value_cache.forget(this); 
 	delete_cache(); 
 }
 
 forest::details::uint_t forest::details::file_data_t::size(){ 
+	merge();
 	return length; 
 }
 
+forest::details::uint_t forest::details::file_data_t::counted_size(){ 
+	// Deltas are counted by the sizes known when they came, not merging
+	// them, and keep the same size after they are merged
+	return counted >= 0 ? counted : length; 
+}
+
 void forest::details::file_data_t::set_file(file_ptr file) { 
 	this->file = file; 
 }
@@ -44,30 +72,141 @@ void forest::details::file_data_t::set_cache(char* buffer) {
 	cached = true; 
 }
 
+bool forest::details::file_data_t::try_uncache() { 
+	// Only values that can be read back from the file are dropped
+	std::unique_lock<mutex> lock(mtx, std::try_to_lock);
+	if(!lock.owns_lock() || !file){
+		return false;
+	}
+	delete_cache();
+	return true;
+}
+
+bool forest::details::file_data_t::is_cached() { 
+	merge();
+	return cached; 
+}
+
+forest::details::uint_t forest::details::file_data_t::get_start() { 
+	return start; 
+}
+
+void forest::details::file_data_t::set_segment(int_t segment) { 
+	this->segment = segment; 
+}
+
+forest::details::int_t forest::details::file_data_t::get_segment() { 
+	return segment; 
+}
+
+void forest::details::file_data_t::set_packed(uint_t packed) { 
+	this->packed = packed; 
+}
+
+forest::details::uint_t forest::details::file_data_t::get_packed() { 
+	return packed; 
+}
+
+forest::details::uint_t forest::details::file_data_t::stored_size() { 
+	merge();
+	return packed ? packed : length; 
+}
+
+void forest::details::file_data_t::set_checksum(int_t checksum) { 
+	this->checksum = checksum; 
+}
+
+forest::details::int_t forest::details::file_data_t::get_checksum() { 
+	return checksum; 
+}
+
+std::unique_lock<forest::details::mutex> forest::details::file_data_t::get_lock() { 
+	return std::unique_lock<mutex>(mtx); 
+}
+
 forest::details::file_data_t::file_data_reader forest::details::file_data_t::get_reader() { 
+	fold();
 	return file_data_reader(this); 
 }
 
+void forest::details::file_data_t::fold() {
+	// Merged value is kept in memory, so it is counted by the value cache
+	if(merge()){
+		value_cache.adopt(this);
+	}
+}
+
+bool forest::details::file_data_t::merge() {
+	if(!pending){
+		return false;
+	}
+	std::lock_guard<mutex> lock(merge_m);
+	if(!pending){
+		return false;
+	}
+	
+	// Reading the base folds the rest of the chain first
+	string val;
+	if(base){
+		val = read_leaf_item(base);
+	}
+	string res = (*op)(base ? &val : nullptr, delta);
+	
+	length = res.size();
+	data_cached = new char[length];
+	std::memcpy(data_cached, res.data(), length);
+	cached = true;
+	if(VALUE_CHECKSUMS){
+		checksum = crc32c(0, res.data(), length);
+	}
+	
+	base = nullptr;
+	op = nullptr;
+	string().swap(delta);
+	pending = false;
+	return true;
+}
+
 
 // File data reader
 forest::details::file_data_t::file_data_reader::file_data_reader(file_data_t* item) : data(item), lock(item->mtx), pos(0) { 
-	if(CACHE_BYTES && data->size() <= (uint_t)CACHE_BYTES && !data->cached) {
+	data->merge();
+	if(!data->file){
+		return;
+	}
+	value_cache.touch(data);
+	if(data->cached){
+		metrics.value_cache_hits.add(1);
+	} else {
+		metrics.value_cache_misses.add(1);
+	}
+	if(!data->cached && value_cache.wants(data)) {
 		temp_cached = true;
 		temp_cache = new char[data->size()];
 	}
+	if(!data->cached && data->packed) {
+		unpack = new decompress_state();
+	}
+	// Values read from the file are checked against the stored checksum
+	verify = !data->cached && data->checksum >= 0;
 }
 
 forest::details::file_data_t::file_data_reader::~file_data_reader() {
 	if(temp_cached) delete[] temp_cache;
+	if(unpack) delete unpack;
 }
 
 forest::details::uint_t forest::details::file_data_t::file_data_reader::read(char* buffer, uint_t count) { 
 	uint_t sz = std::min(data->size()-pos, count);
 	if(!sz){
-		// Save cache
+		// Save cache if it is worth more than values it evicts
 		if(temp_cached){
-			data->data_cached = temp_cache;
-			data->cached = true;
+			if(value_cache.admit(data)){
+				data->data_cached = temp_cache;
+				data->cached = true;
+			} else {
+				delete[] temp_cache;
+			}
 			temp_cached = false;
 			temp_cache = nullptr;
 		}
@@ -77,13 +216,27 @@ forest::details::uint_t forest::details::file_data_t::file_data_reader::read(cha
 		std::memcpy(buffer, data->data_cached+pos, sz);
 	}
 	else{
-		auto lock = data->file->get_lock();
-		data->file->seekg(data->start + pos);
-		data->file->read(buffer, sz);
+		// Value read lazily is a disk read like the node it came from
+		IOScheduler::ticket io(IOScheduler::IO_CLASS::READ);
+		io.set_bytes(sz);
+		if(unpack){
+			unpack->read(data, buffer, sz);
+		} else {
+			auto lock = data->file->get_lock();
+			data->file->seekg(data->start + pos);
+			data->file->read(buffer, sz);
+		}
 		if(temp_cached){
 			std::memcpy(temp_cache + pos, buffer, sz);
 		}
+		if(verify){
+			crc = crc32c(crc, buffer, sz);
+		}
 	}
 	pos += sz;
+	if(verify && pos == data->size() && crc != (uint32_t)data->checksum){
+		L_ERR("[file_data_reader::read]-(checksum mismatch)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
 	return sz;
 }
@@ -1,11 +1,15 @@
 #ifndef FOREST_FILE_DATA_H
 #define FOREST_FILE_DATA_H
 
+#include <list>
 #include "dbutils.hpp"
 
 namespace forest{
 namespace details{
 	
+	class ValueCache;
+	struct decompress_state;
+	
 	class file_data_t{
 		
 		using fn = std::function<void(file_data_t* self, char*, int)>;
@@ -13,13 +17,28 @@ namespace details{
 		public:
 			file_data_t(file_ptr file, uint_t start, uint_t length);
 			file_data_t(const char* data, uint_t length);
+			file_data_t(file_data_ptr base, merge_operator_ptr op, string delta);
 			virtual ~file_data_t();
 			uint_t size();
+			uint_t counted_size();
 			void set_file(file_ptr file);
 			void set_start(uint_t start);
 			void set_length(uint_t length);
 			void delete_cache();
 			void set_cache(char* buffer);
+			bool try_uncache();
+			bool is_cached();
+			uint_t get_start();
+			void set_segment(int_t segment);
+			int_t get_segment();
+			void set_packed(uint_t packed);
+			uint_t get_packed();
+			uint_t stored_size();
+			void set_checksum(int_t checksum);
+			int_t get_checksum();
+			std::unique_lock<mutex> get_lock();
+			// Caller must not hold the lock of the value
+			void fold();
 			
 			file_ptr file;
 			std::mutex m,g,o;
@@ -35,6 +54,9 @@ namespace details{
 				private:
 					bool temp_cached = false;
 					char* temp_cache;
+					decompress_state* unpack = nullptr;
+					bool verify = false;
+					uint32_t crc = 0;
 					file_data_t* data;
 					std::lock_guard<mutex> lock;
 					uint_t pos;
@@ -42,12 +64,30 @@ namespace details{
 			file_data_reader get_reader();
 			
 			friend file_data_reader;
+			friend ValueCache;
 			
 		private:
+			bool merge();
+
 			uint_t start, length;
+			int_t segment = -1;
+			uint_t packed = 0;
+			int_t checksum = -1;
 			char* data_cached;
 			mutex mtx;
 			bool cached = false;
+			std::atomic<int> value_cache_shard = -1;
+			std::atomic<uint_t> value_cache_key = 0;
+			std::list<file_data_t*>::iterator value_cache_it;
+			
+			// Delta waiting to be merged into the previous value
+			std::atomic<bool> pending = false;
+			file_data_ptr base;
+			merge_operator_ptr op;
+			string delta;
+			int depth = 0;
+			int_t counted = -1;
+			mutex merge_m;
 	};
 	
 } // details
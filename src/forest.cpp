@@ -4,10 +4,20 @@ namespace forest{
 namespace details{
 
 	Savior* savior;
+	ValueLog* value_log;
+	Dictionaries* dictionaries;
+	Journal* journal;
+	TransactionLog* transaction_log;
+	Warmer* warmer;
+	Thread_pool* thread_pool;
+	IOScheduler* io_scheduler;
 	bool folding = false;
 
 	tree_ptr FOREST;
 	bool blossomed = false;
+	
+	std::unordered_map<string, merge_operator_ptr> merge_operators;
+	mutex merge_operators_m;
 
 } // details
 } // forest
@@ -23,16 +33,36 @@ void forest::bloom(details::string path)
 
 	details::cache::init_cache();
 
+	// Every background job of the forest runs on the same pool. Scheduler,
+	// collector, trainer and warmer may hold a worker each for a long time
+	int threads = details::THREAD_POOL_SIZE > 0 ? details::THREAD_POOL_SIZE : std::thread::hardware_concurrency();
+	details::thread_pool = new Thread_pool(std::max(threads, details::THREAD_POOL_MIN));
+	details::io_scheduler = new details::IOScheduler();
+
 	DBFS::set_root(path);
+	
+	// Roll back changes interrupted by a crash before reading any node
+	details::journal = new details::Journal();
 	if(!DBFS::exists(details::ROOT_TREE)){
 		details::create_root_file();
 	} 
 
 	details::init_savior();
+	details::value_log = new details::ValueLog();
+	details::dictionaries = new details::Dictionaries();
 	details::open_root();
+	
+	// Transactions interrupted before their nodes were saved are replayed
+	details::transaction_log = new details::TransactionLog();
+	details::warmer = new details::Warmer();
 
 	details::blossomed = true;
 
+	// Requests are served while the hot nodes of the last session are read
+	if(details::WARM_CACHE){
+		details::warmer->warm();
+	}
+
 	L_PUB("[forest::bloom]-end");
 }
 
@@ -47,9 +77,28 @@ void forest::fold()
 	details::folding = true;
 	details::blossomed = false;
 
+	// Nodes being warmed are not needed anymore
+	details::warmer->stop();
+
+	// Dictionary rebuilding may still save the tree base,
+	// and the log checkpoint may still save anything
+	details::dictionaries->wait();
+	details::transaction_log->wait();
+	details::value_log->stop();
+	details::warmer->save();
 	details::cache::release_cache();
 	details::release_savior();
 	details::close_root();
+	delete details::value_log;
+	details::value_log = nullptr;
+	delete details::dictionaries;
+	delete details::journal;
+	delete details::transaction_log;
+	details::transaction_log = nullptr;
+	delete details::warmer;
+	delete details::thread_pool;
+	delete details::io_scheduler;
+	details::io_scheduler = nullptr;
 
 	L_PUB("[forest::fold]-end");
 }
@@ -59,6 +108,11 @@ bool forest::blooms()
 	return details::blossomed;
 }
 
+bool forest::warms()
+{
+	return details::blossomed && details::warmer->is_warming();
+}
+
 int forest::get_save_queue_size()
 {
 	return details::savior->save_queue_size();
@@ -69,7 +123,66 @@ int forest::get_opened_files_count()
 	return details::opened_files_count.load();
 }
 
-void forest::plant_tree(TREE_TYPES type, details::string name, int factor, details::string annotation)
+forest::size_t forest::get_value_cache_bytes()
+{
+	return details::value_cache.size();
+}
+
+double forest::get_pool_utilization()
+{
+	return details::thread_pool->utilization();
+}
+
+int forest::get_pool_queue_size()
+{
+	return details::thread_pool->queue_size();
+}
+
+forest::IOStats forest::get_io_stats()
+{
+	return details::io_scheduler->get_stats();
+}
+
+forest::StallStats forest::get_stall_stats()
+{
+	return details::savior->stall_stats();
+}
+
+forest::Metrics forest::metrics()
+{
+	Metrics m = details::metrics.snapshot();
+	if(blooms()){
+		m.save_queue_size = details::savior->save_queue_size();
+		StallStats stall = details::savior->stall_stats();
+		m.write_stalls = stall.stalls;
+		m.write_stall_mks = stall.stall_mks;
+		m.rejected_writes = stall.rejected;
+		m.dirty_bytes = stall.dirty_bytes;
+	}
+	return m;
+}
+
+forest::string forest::metrics_text()
+{
+	return details::prometheus_text(metrics());
+}
+
+std::vector<forest::LockStats> forest::lock_report()
+{
+	return details::lock_profiler::report();
+}
+
+forest::string forest::lock_report_text(int limit)
+{
+	return details::lock_profiler::report_text(limit);
+}
+
+void forest::reset_lock_report()
+{
+	details::lock_profiler::reset();
+}
+
+void forest::plant_tree(TREE_TYPES type, details::string name, int factor, details::string annotation, COMPRESSION_TYPES compression)
 {
 	L_PUB("[forest::plant_tree]-" + name);
 
@@ -87,7 +200,7 @@ void forest::plant_tree(TREE_TYPES type, details::string name, int factor, detai
 
 	details::string file_name = DBFS::random_filename();
 
-	details::tree_ptr tree = details::tree_ptr(new details::Tree(file_name, type, factor, annotation));
+	details::tree_ptr tree = details::tree_ptr(new details::Tree(file_name, type, factor, annotation, compression));
 
 	details::insert_tree(name, file_name, tree);
 }
@@ -138,6 +251,51 @@ forest::Tree forest::find_tree(details::string name)
 	return details::tree_owner_ptr(new details::tree_owner(details::reach_tree(path)));
 }
 
+forest::TreeStats forest::tree_stats(Tree tree)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+	
+	return details::extract_native_tree(tree)->get_stats();
+}
+
+forest::VerifyReport forest::verify(details::string tree_name)
+{
+	return verify(find_tree(tree_name));
+}
+
+forest::VerifyReport forest::verify(Tree tree)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+	
+	details::tree_ptr t = details::extract_native_tree(tree);
+	
+	L_PUB("[forest::verify]-" + t->get_name());
+	
+	return t->verify();
+}
+
+void forest::train_dictionary(details::string tree_name)
+{
+	train_dictionary(find_tree(tree_name));
+}
+
+void forest::train_dictionary(Tree tree)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+	
+	details::tree_ptr t = details::extract_native_tree(tree);
+	
+	L_PUB("[forest::train_dictionary]-" + t->get_name());
+	
+	t->train_dictionary();
+}
+
 void forest::insert_leaf(details::string tree_name, details::tree_t::key_type key, details::detached_leaf_ptr val)
 {
 	if(!blooms()){
@@ -219,6 +377,85 @@ void forest::remove_leaf(Tree tree, details::tree_t::key_type key)
 	details::extract_native_tree(tree)->erase(key);
 }
 
+bool forest::cas_leaf(details::string tree_name, details::tree_t::key_type key, details::detached_leaf_ptr expected, details::detached_leaf_ptr val)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	return cas_leaf(find_tree(tree_name), key, expected, val);
+}
+
+bool forest::cas_leaf(Tree tree, details::tree_t::key_type key, details::detached_leaf_ptr expected, details::detached_leaf_ptr val)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	details::tree_ptr t = details::extract_native_tree(tree);
+
+	L_PUB("[forest::cas_leaf]-" + t->get_name() + "_" + key);
+
+	// Null leaf stands for the missing key
+	details::file_data_ptr e = expected ? details::extract_leaf_val(expected) : nullptr;
+	details::file_data_ptr v = val ? details::extract_leaf_val(val) : nullptr;
+	return t->cas(key, e, v);
+}
+
+forest::DetachedLeaf forest::merge_leaf(details::string tree_name, details::tree_t::key_type key, LeafMerger fn)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	return merge_leaf(find_tree(tree_name), key, fn);
+}
+
+forest::DetachedLeaf forest::merge_leaf(Tree tree, details::tree_t::key_type key, LeafMerger fn)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	details::tree_ptr t = details::extract_native_tree(tree);
+
+	L_PUB("[forest::merge_leaf]-" + t->get_name() + "_" + key);
+
+	details::file_data_ptr res = t->merge(key, [&fn](details::file_data_ptr cur){
+		DetachedLeaf next = fn(cur ? details::detached_leaf_ptr(new details::detached_leaf(cur)) : nullptr);
+		return next ? details::extract_leaf_val(next) : nullptr;
+	});
+	return res ? details::detached_leaf_ptr(new details::detached_leaf(res)) : nullptr;
+}
+
+void forest::merge_delta(details::string tree_name, details::tree_t::key_type key, details::string op_name, details::string delta)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	merge_delta(find_tree(tree_name), key, op_name, delta);
+}
+
+void forest::merge_delta(Tree tree, details::tree_t::key_type key, details::string op_name, details::string delta)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	details::tree_ptr t = details::extract_native_tree(tree);
+
+	L_PUB("[forest::merge_delta]-" + t->get_name() + "_" + key + "_" + op_name);
+
+	t->merge_delta(key, details::get_merge_operator(op_name), delta);
+}
+
+void forest::register_merge_operator(details::string name, MergeOperator op)
+{
+	std::lock_guard<details::mutex> lock(details::merge_operators_m);
+	details::merge_operators[name] = details::merge_operator_ptr(new details::merge_operator_t(op));
+}
+
 forest::Leaf forest::find_leaf(details::string tree_name, details::tree_t::key_type key)
 {
 	if(!blooms()){
@@ -347,6 +584,64 @@ forest::Leaf forest::find_leaf(Tree tree, details::tree_t::key_type key, LEAF_PO
 	return rc;
 }
 
+std::vector<forest::Leaf> forest::find_leaves(details::string tree_name, std::vector<details::tree_t::key_type> keys)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	return find_leaves(find_tree(tree_name), std::move(keys));
+}
+
+std::vector<forest::Leaf> forest::find_leaves(Tree tree, std::vector<details::tree_t::key_type> keys)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+
+	details::tree_ptr nt = details::extract_native_tree(tree);
+
+	L_PUB("[forest::find_leaves]-" + nt->get_name() + "_" + details::to_string(keys.size()));
+
+	std::vector<details::tree_t::iterator> its = nt->find(keys);
+	std::vector<Leaf> res;
+	res.reserve(its.size());
+	for(auto& it : its){
+		res.push_back(details::LeafRecord_ptr(new details::LeafRecord(std::move(it), nt)));
+	}
+
+	return res;
+}
+
+forest::Snapshot forest::snapshot(details::string tree_name)
+{
+	return snapshot(find_tree(tree_name));
+}
+
+forest::Snapshot forest::snapshot(Tree tree)
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+	
+	details::tree_ptr nt = details::extract_native_tree(tree);
+	
+	L_PUB("[forest::snapshot]-" + nt->get_name());
+	
+	return details::Snapshot_ptr(new details::Snapshot(nt));
+}
+
+forest::Transaction forest::begin_transaction()
+{
+	if(!blooms()){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+	
+	L_PUB("[forest::begin_transaction]");
+	
+	return details::Transaction_ptr(new details::Transaction());
+}
+
 forest::DetachedLeaf forest::make_leaf(details::string data)
 {
 	return details::detached_leaf_ptr(new details::detached_leaf(details::leaf_value(data)));
@@ -369,6 +664,11 @@ forest::LeafFile forest::create_leaf_file()
 	return f;
 }
 
+forest::LeafWriter forest::make_leaf_writer()
+{
+	return details::leaf_writer_ptr(new details::leaf_writer());
+}
+
 
 /* Configurations */
 
@@ -407,6 +707,11 @@ void forest::config_cache_bytes(int bytes)
 	details::CACHE_BYTES = bytes;
 }
 
+void forest::config_value_cache_bytes(int bytes)
+{
+	details::VALUE_CACHE_BYTES = bytes;
+}
+
 void forest::config_chunk_bytes(int bytes)
 {
 	details::CHUNK_SIZE = bytes;
@@ -427,6 +732,88 @@ void forest::config_savior_queue_size(int length)
 	details::SAVIOUR_QUEUE_LENGTH = length;
 }
 
+void forest::config_save_flush_limit(int count)
+{
+	details::SAVIOUR_FLUSH_LIMIT = count;
+}
+
+void forest::config_value_log_threshold(int bytes)
+{
+	details::VALUE_LOG_THRESHOLD = bytes;
+}
+
+void forest::config_value_log_segment_bytes(int bytes)
+{
+	details::VALUE_LOG_SEGMENT_BYTES = bytes;
+}
+
+void forest::config_compression_level(int level)
+{
+	details::COMPRESSION_LEVEL = level;
+}
+
+void forest::config_compress_value_bytes(int bytes)
+{
+	details::COMPRESS_VALUE_BYTES = bytes;
+}
+
+void forest::config_value_checksums(bool enabled)
+{
+	details::VALUE_CHECKSUMS = enabled;
+}
+
+void forest::config_dictionary_bytes(int bytes)
+{
+	details::DICT_BYTES = bytes;
+}
+
+void forest::config_dictionary_value_bytes(int bytes)
+{
+	details::DICT_VALUE_BYTES = bytes;
+}
+
+void forest::config_warm_cache(bool enabled)
+{
+	details::WARM_CACHE = enabled;
+}
+
+void forest::config_thread_pool_size(int threads)
+{
+	details::THREAD_POOL_SIZE = threads;
+}
+
+void forest::config_io_write_share(int percent)
+{
+	details::IO_WRITE_SHARE = percent;
+}
+
+void forest::config_io_write_deadline_mks(int mks)
+{
+	details::IO_WRITE_DEADLINE_MKS = mks;
+}
+
+void forest::config_save_watermarks(int low_items, int high_items)
+{
+	details::SAVE_LOW_ITEMS = low_items;
+	details::SAVE_HIGH_ITEMS = high_items;
+}
+
+void forest::config_dirty_bytes_watermarks(int low_bytes, int high_bytes)
+{
+	details::SAVE_LOW_BYTES = low_bytes;
+	details::SAVE_HIGH_BYTES = high_bytes;
+}
+
+void forest::config_reject_stalled_writes(bool enabled)
+{
+	details::SAVE_REJECT_STALLED = enabled;
+}
+
+void forest::config_lock_profiling(bool enabled)
+{
+	details::lock_profiler::enable(enabled);
+}
+
 /*********************************************************************************/
 
 
@@ -445,6 +832,16 @@ void forest::details::close_root()
 	FOREST = nullptr;
 }
 
+forest::details::merge_operator_ptr forest::details::get_merge_operator(string name)
+{
+	std::lock_guard<mutex> lock(merge_operators_m);
+	auto it = merge_operators.find(name);
+	if(it == merge_operators.end()){
+		throw TreeException(TreeException::ERRORS::BAD_INPUT_PARAMETER);
+	}
+	return it->second;
+}
+
 void forest::details::init_savior()
 {
 	savior = new Savior();
@@ -499,6 +896,7 @@ void forest::details::erase_tree(string path)
 	nt->get_tree()->unlock_write();
 	
 	nt->get_tree()->clear();
+	nt->drop_dictionaries();
 
 	// Clear cache
 	cache::tree_lock();
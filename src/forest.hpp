@@ -9,48 +9,92 @@
 #include "dbutils.hpp"
 #include "tree.hpp"
 #include "leaf_record.hpp"
+#include "snapshot.hpp"
+#include "transaction.hpp"
 #include "savior.hpp"
 #include "detached_leaf.hpp"
+#include "leaf_writer.hpp"
+#include "value_log.hpp"
+#include "dictionary.hpp"
+#include "journal.hpp"
+#include "transaction_log.hpp"
+#include "warmer.hpp"
 #include "tree_owner.hpp"
+#include "metrics.hpp"
 
 namespace forest{
 
 	// Aliases
 	using Leaf = details::LeafRecord_ptr;
+	using Snapshot = details::Snapshot_ptr;
+	using Transaction = details::Transaction_ptr;
 	using Tree = details::tree_owner_ptr;
 	using DetachedLeaf = details::detached_leaf_ptr;
 	using LeafReader = details::file_data_t::file_data_reader;
 	using LeafFile = details::file_ptr;
+	using LeafWriter = details::leaf_writer_ptr;
 	using LeafKey = details::tree_t::key_type;
 	using size_t = details::uint_t;
 	using string = details::string;
+	using TreeStats = details::tree_stats_t;
+	using VerifyReport = details::verify_report_t;
+	// Called without locks, again if the key was changed meanwhile
+	using LeafMerger = std::function<DetachedLeaf(DetachedLeaf)>;
+	using MergeOperator = details::merge_operator_t;
+	using IOStats = details::IOScheduler::io_stats_t;
+	using StallStats = details::Savior::stall_stats_t;
+	using Metrics = details::metrics_t;
+	using Histogram = details::histogram_t;
+	using LockStats = details::lock_stats_t;
 
 	// Forest modifications
-	void plant_tree(TREE_TYPES type, details::string name, int factor = 0, details::string annotation = "");
+	void plant_tree(TREE_TYPES type, details::string name, int factor = 0, details::string annotation = "", COMPRESSION_TYPES compression = COMPRESSION_TYPES::NONE);
 	void cut_tree(details::string name);
 	Tree find_tree(details::string name);
+	TreeStats tree_stats(Tree tree);
+	void train_dictionary(details::string tree_name);
+	void train_dictionary(Tree tree);
+	VerifyReport verify(details::string tree_name);
+	VerifyReport verify(Tree tree);
 
 	// Tree operations by name
 	void insert_leaf(details::string tree_name, details::tree_t::key_type key, details::detached_leaf_ptr val);
 	void update_leaf(details::string tree_name, details::tree_t::key_type key, details::detached_leaf_ptr val);
 	void remove_leaf(details::string tree_name, details::tree_t::key_type key);
+	bool cas_leaf(details::string tree_name, details::tree_t::key_type key, details::detached_leaf_ptr expected, details::detached_leaf_ptr val);
+	DetachedLeaf merge_leaf(details::string tree_name, details::tree_t::key_type key, LeafMerger fn);
+	void merge_delta(details::string tree_name, details::tree_t::key_type key, details::string op_name, details::string delta);
 	Leaf find_leaf(details::string tree_name, details::tree_t::key_type key);
 	Leaf find_leaf(details::string tree_name, LEAF_POSITION position = LEAF_POSITION::BEGIN);
 	Leaf find_leaf(details::string tree_name, details::tree_t::key_type key, LEAF_POSITION position);
+	std::vector<Leaf> find_leaves(details::string tree_name, std::vector<details::tree_t::key_type> keys);
+	Snapshot snapshot(details::string tree_name);
 
 	// Tree operations by tree
 	void insert_leaf(Tree tree, details::tree_t::key_type key, details::detached_leaf_ptr val);
 	void update_leaf(Tree tree, details::tree_t::key_type key, details::detached_leaf_ptr val);
 	void remove_leaf(Tree tree, details::tree_t::key_type key);
+	bool cas_leaf(Tree tree, details::tree_t::key_type key, details::detached_leaf_ptr expected, details::detached_leaf_ptr val);
+	DetachedLeaf merge_leaf(Tree tree, details::tree_t::key_type key, LeafMerger fn);
+	void merge_delta(Tree tree, details::tree_t::key_type key, details::string op_name, details::string delta);
 	Leaf find_leaf(Tree tree, details::tree_t::key_type key);
 	Leaf find_leaf(Tree tree, LEAF_POSITION position = LEAF_POSITION::BEGIN);
 	Leaf find_leaf(Tree tree, details::tree_t::key_type key, LEAF_POSITION position);
+	std::vector<Leaf> find_leaves(Tree tree, std::vector<details::tree_t::key_type> keys);
+	Snapshot snapshot(Tree tree);
+
+	// Transactions
+	Transaction begin_transaction();
+
+	// Merge operators
+	void register_merge_operator(details::string name, MergeOperator op);
 
 	// Leaf Builder
 	DetachedLeaf make_leaf(details::string data);
 	DetachedLeaf make_leaf(char* buffer, details::uint_t length);
 	DetachedLeaf make_leaf(LeafFile file, details::uint_t start, details::uint_t length);
 	LeafFile create_leaf_file();
+	LeafWriter make_leaf_writer();
 
 	// Init methods
 	void bloom(details::string path);
@@ -58,8 +102,19 @@ namespace forest{
 
 	// Status methods
 	bool blooms();
+	bool warms();
 	int get_save_queue_size();
 	int get_opened_files_count();
+	size_t get_value_cache_bytes();
+	double get_pool_utilization();
+	int get_pool_queue_size();
+	IOStats get_io_stats();
+	StallStats get_stall_stats();
+	Metrics metrics();
+	string metrics_text();
+	std::vector<LockStats> lock_report();
+	string lock_report_text(int limit = 20);
+	void reset_lock_report();
 
 	// Configurations
 	void config_root_factor(int root_factor);
@@ -69,10 +124,27 @@ namespace forest{
 	void config_leaf_cache_length(int length);
 	void config_tree_cache_length(int length);
 	void config_cache_bytes(int bytes);
+	void config_value_cache_bytes(int bytes);
 	void config_chunk_bytes(int bytes);
 	void config_opened_files_limit(int count);
 	void config_save_schedule_mks(int mks);
 	void config_savior_queue_size(int length);
+	void config_save_flush_limit(int count);
+	void config_value_log_threshold(int bytes);
+	void config_value_log_segment_bytes(int bytes);
+	void config_compression_level(int level);
+	void config_compress_value_bytes(int bytes);
+	void config_value_checksums(bool enabled);
+	void config_dictionary_bytes(int bytes);
+	void config_dictionary_value_bytes(int bytes);
+	void config_warm_cache(bool enabled);
+	void config_thread_pool_size(int threads);
+	void config_io_write_share(int percent);
+	void config_io_write_deadline_mks(int mks);
+	void config_save_watermarks(int low_items, int high_items);
+	void config_dirty_bytes_watermarks(int low_bytes, int high_bytes);
+	void config_reject_stalled_writes(bool enabled);
+	void config_lock_profiling(bool enabled);
 
 	//////////// Private ////////////
 
@@ -91,6 +163,7 @@ namespace forest{
 		void leave_tree(tree_ptr tree);
 
 		// Other methods
+		merge_operator_ptr get_merge_operator(string name);
 		void init_savior();
 		void release_savior();
 	}
@@ -0,0 +1,93 @@
+#include "io_scheduler.hpp"
+
+// ticket
+thread_local int forest::details::IOScheduler::ticket::held = 0;
+
+forest::details::IOScheduler::ticket::ticket(IO_CLASS cls) : cls(cls)
+{
+	// Values read after the forest is folded are not scheduled
+	outer = !held++ && io_scheduler;
+	if(outer){
+		io_scheduler->start(cls);
+	}
+}
+
+forest::details::IOScheduler::ticket::~ticket()
+{
+	--held;
+	if(outer){
+		io_scheduler->finish(cls, bytes);
+	}
+}
+
+void forest::details::IOScheduler::ticket::set_bytes(uint_t bytes)
+{
+	this->bytes = bytes;
+}
+
+
+// IOScheduler
+void forest::details::IOScheduler::start(IO_CLASS cls)
+{
+	std::unique_lock<mutex> lock(m);
+	
+	if(cls == IO_CLASS::READ){
+		// Idle reads do not save their share for later
+		if(!reads_active){
+			read_time = std::max(read_time, write_time);
+		}
+		++reads_active;
+		++stats.reads;
+		read_time += cost(cls, IO_OP_BYTES);
+		return;
+	}
+	
+	if(!writes_active){
+		write_time = std::max(write_time, read_time);
+	}
+	
+	// Save waits while it is ahead of the reads running meanwhile
+	auto arrived = std::chrono::steady_clock::now();
+	auto deadline = arrived + std::chrono::microseconds(IO_WRITE_DEADLINE_MKS);
+	bool delayed = false;
+	while(reads_active && write_time > read_time){
+		delayed = true;
+		if(cv.wait_until(lock, deadline) == std::cv_status::timeout){
+			++stats.boosted;
+			break;
+		}
+	}
+	if(delayed){
+		++stats.delayed;
+		stats.wait_mks += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - arrived).count();
+	}
+	
+	++writes_active;
+	++stats.writes;
+	write_time += cost(cls, IO_OP_BYTES);
+}
+
+void forest::details::IOScheduler::finish(IO_CLASS cls, uint_t bytes)
+{
+	std::unique_lock<mutex> lock(m);
+	if(cls == IO_CLASS::READ){
+		--reads_active;
+		read_time += cost(cls, bytes);
+	} else {
+		--writes_active;
+		write_time += cost(cls, bytes);
+	}
+	cv.notify_all();
+}
+
+forest::details::IOScheduler::io_stats_t forest::details::IOScheduler::get_stats()
+{
+	std::unique_lock<mutex> lock(m);
+	return stats;
+}
+
+double forest::details::IOScheduler::cost(IO_CLASS cls, uint_t bytes)
+{
+	int share = std::min(std::max(IO_WRITE_SHARE, 1), 99);
+	return (double)bytes / (cls == IO_CLASS::WRITE ? share : 100 - share);
+}
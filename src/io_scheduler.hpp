@@ -0,0 +1,66 @@
+#ifndef FOREST_IO_SCHEDULER_H
+#define FOREST_IO_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include "dbutils.hpp"
+#include "variables.hpp"
+
+namespace forest{
+namespace details{
+
+	// Orders disk access of node reads and background saves.
+	// Reads missing the cache are never delayed. While reads are running,
+	// saves get their share of the disk: every operation costs its bytes
+	// plus a fixed price, so both bandwidth and IOPS are shared. A save
+	// waiting longer than the deadline goes anyway, so it is never starved.
+	class IOScheduler{
+		
+		public:
+			enum class IO_CLASS{ READ, WRITE };
+			
+			struct io_stats_t{
+				uint_t reads = 0;
+				uint_t writes = 0;
+				uint_t delayed = 0;
+				uint_t boosted = 0;
+				uint_t wait_mks = 0;
+			};
+			
+			// Holds the admission for the time of the operation. Ticket
+			// taken inside another one of the same thread joins it
+			class ticket{
+				public:
+					ticket(IO_CLASS cls);
+					~ticket();
+					void set_bytes(uint_t bytes);
+				
+				private:
+					IO_CLASS cls;
+					uint_t bytes = 0;
+					bool outer;
+					static thread_local int held;
+			};
+			
+			void start(IO_CLASS cls);
+			void finish(IO_CLASS cls, uint_t bytes);
+			io_stats_t get_stats();
+		
+		private:
+			double cost(IO_CLASS cls, uint_t bytes);
+			
+			int reads_active = 0;
+			int writes_active = 0;
+			double read_time = 0;
+			double write_time = 0;
+			io_stats_t stats;
+			mutex m;
+			std::condition_variable cv;
+	};
+	
+	extern IOScheduler* io_scheduler;
+
+} // details
+} // forest
+
+#endif // FOREST_IO_SCHEDULER_H
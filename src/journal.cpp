@@ -0,0 +1,339 @@
+#include "journal.hpp"
+
+
+forest::details::Journal::Journal()
+{
+	// Compaction replaces the journal with its tail written aside
+	string next = JOURNAL_FILE + "_next";
+	if(DBFS::exists(next)){
+		if(DBFS::exists(JOURNAL_FILE)){
+			DBFS::remove(next);
+		} else {
+			DBFS::move(next, JOURNAL_FILE);
+		}
+	}
+	
+	if(DBFS::exists(JOURNAL_FILE)){
+		recover();
+	}
+	open();
+}
+
+forest::details::Journal::~Journal()
+{
+	// Every group is committed by the Savior before folding
+	file = nullptr;
+	DBFS::remove(JOURNAL_FILE);
+}
+
+forest::details::Journal::group_t forest::details::Journal::begin()
+{
+	std::lock_guard<mutex> lock(mtx);
+	group_t group = next_group++;
+	groups[group].parent = group;
+	return group;
+}
+
+void forest::details::Journal::record(group_t group, const string& target, const string& backup, const string& temp)
+{
+	std::lock_guard<mutex> lock(mtx);
+	
+	// Group rewriting the file of an open group could not commit without it
+	auto pin = pins.find(target);
+	if(pin != pins.end() && groups.count(pin->second)){
+		unite(group, pin->second);
+	}
+	pins[target] = group;
+	groups[group].targets.push_back(target);
+
+	// Names are written on separate lines as tree names may contain spaces
+	write(group, "R " + std::to_string(group) + "\n" + target + "\n" + backup + "\n" + temp + "\n");
+}
+
+void forest::details::Journal::attach(group_t group, const string& target)
+{
+	std::lock_guard<mutex> lock(mtx);
+	auto pin = pins.find(target);
+	if(pin != pins.end() && groups.count(pin->second)){
+		unite(group, pin->second);
+	}
+}
+
+void forest::details::Journal::join(group_t group, group_t other)
+{
+	std::lock_guard<mutex> lock(mtx);
+	if(groups.count(other)){
+		unite(group, other);
+	}
+}
+
+void forest::details::Journal::commit(group_t group, std::vector<std::function<void()>> on_commit)
+{
+	std::vector<std::function<void()>> done;
+	{
+		std::lock_guard<mutex> lock(mtx);
+		group_state_t& state = groups[group];
+		state.committed = true;
+		for(auto& fn : on_commit){
+			state.on_commit.push_back(std::move(fn));
+		}
+		if(state.written){
+			write(group, "C " + std::to_string(group) + "\n");
+		}
+		
+		// Previous versions are kept until every joined group commits
+		group_t root = find(group);
+		std::vector<group_t> members;
+		for(auto& it : groups){
+			if(find(it.first) != root){
+				continue;
+			}
+			if(!it.second.committed){
+				return;
+			}
+			members.push_back(it.first);
+		}
+		
+		for(auto member : members){
+			group_state_t& st = groups[member];
+			for(auto& target : st.targets){
+				auto pin = pins.find(target);
+				if(pin != pins.end() && pin->second == member){
+					pins.erase(pin);
+				}
+			}
+			for(auto& fn : st.on_commit){
+				done.push_back(std::move(fn));
+			}
+		}
+		for(auto member : members){
+			groups.erase(member);
+		}
+		cv.notify_all();
+		
+		compact();
+	}
+	
+	for(auto& fn : done){
+		fn();
+	}
+}
+
+void forest::details::Journal::sync()
+{
+	// Groups begun later are waited for only when joined with earlier ones
+	std::unique_lock<mutex> lock(mtx);
+	group_t upto = next_group;
+	while(groups.size() && groups.begin()->first < upto){
+		cv.wait(lock);
+	}
+}
+
+void forest::details::Journal::recover()
+{
+	DBFS::File* f = new DBFS::File(JOURNAL_FILE);
+	std::istream& in = f->stream();
+
+	std::vector<std::pair<group_t, record_t>> records;
+	std::map<group_t, group_t> parents;
+	std::map<group_t, bool> committed;
+	
+	std::function<group_t(group_t)> find = [&parents, &find](group_t group){
+		group_t parent = parents.count(group) ? parents[group] : group;
+		if(parent == group){
+			return group;
+		}
+		return parents[group] = find(parent);
+	};
+
+	string line;
+	while(std::getline(in, line)){
+		// Line without the end of line was not completely written
+		if(in.eof() || line.size() < 3){
+			break;
+		}
+		std::istringstream ids(line.substr(2));
+		group_t group, other;
+		ids >> group;
+		committed.insert(std::make_pair(group, false));
+		if(line[0] == 'C'){
+			committed[group] = true;
+			continue;
+		}
+		if(line[0] == 'J'){
+			ids >> other;
+			committed.insert(std::make_pair(other, false));
+			group_t a = find(group), b = find(other);
+			if(a != b){
+				parents[b] = a;
+			}
+			continue;
+		}
+
+		// Torn record at the end means its file was not touched yet
+		record_t rec;
+		if(!std::getline(in, rec.target) || !std::getline(in, rec.backup) || !std::getline(in, rec.temp) || in.eof()){
+			break;
+		}
+		records.push_back(std::make_pair(group, rec));
+	}
+	delete f;
+	
+	// Joined groups are committed only if all of them are
+	std::map<group_t, bool> components;
+	for(auto& it : committed){
+		group_t root = find(it.first);
+		components[root] = (components.count(root) ? components[root] : true) && it.second;
+	}
+
+	std::vector<record_t> undo;
+	for(auto& it : records){
+		if(components[find(it.first)]){
+			// Previous versions were not needed anymore
+			record_t& rec = it.second;
+			if(rec.backup.size() && DBFS::exists(rec.backup)){
+				DBFS::remove(rec.backup);
+			}
+		} else {
+			undo.push_back(it.second);
+		}
+	}
+	
+	// Records of all the rolled back groups are undone in the reverse order
+	// of the journal, so a file replaced by several groups gets its oldest version
+	if(undo.size()){
+		L_ERR("[Journal::recover]-(rollback of " + std::to_string(undo.size()) + " files)");
+		rollback(undo);
+	}
+
+	DBFS::remove(JOURNAL_FILE);
+}
+
+void forest::details::Journal::rollback(std::vector<record_t>& records)
+{
+	// Undo in reverse order, the same file may be replaced several times
+	for(auto it = records.rbegin(); it != records.rend(); ++it){
+		if(it->temp.size() && DBFS::exists(it->temp)){
+			DBFS::remove(it->temp);
+		}
+
+		if(!it->backup.size()){
+			// File was created by the group
+			if(DBFS::exists(it->target)){
+				DBFS::remove(it->target);
+			}
+		} else if(DBFS::exists(it->backup)){
+			if(DBFS::exists(it->target)){
+				DBFS::remove(it->target);
+			}
+			DBFS::move(it->backup, it->target);
+		}
+	}
+}
+
+void forest::details::Journal::open()
+{
+	file = file_ptr(new DBFS::File(JOURNAL_FILE));
+	bytes = 0;
+}
+
+void forest::details::Journal::write(group_t group, const string& data)
+{
+	group_state_t& state = groups[group];
+	if(!state.written){
+		state.written = true;
+		state.offset = bytes;
+	}
+	
+	file->seekp(bytes);
+	file->write(data);
+	file->stream().flush();
+	bytes += data.size();
+
+	if(file->fail()){
+		L_ERR("[Journal::write]-(cannot write file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+}
+
+void forest::details::Journal::unite(group_t group, group_t other)
+{
+	group_t a = find(group), b = find(other);
+	if(a == b){
+		return;
+	}
+	
+	// Both groups are counted as written, so both of them commit in the journal
+	if(!groups[other].written){
+		groups[other].written = true;
+		groups[other].offset = bytes;
+	}
+	write(group, "J " + std::to_string(group) + " " + std::to_string(other) + "\n");
+	groups[b].parent = a;
+}
+
+forest::details::Journal::group_t forest::details::Journal::find(group_t group)
+{
+	group_state_t& state = groups[group];
+	if(state.parent == group){
+		return group;
+	}
+	return state.parent = find(state.parent);
+}
+
+void forest::details::Journal::compact()
+{
+	if(bytes < (uint_t)JOURNAL_BYTES){
+		return;
+	}
+	
+	// Everything before the first line of the oldest open group is committed
+	uint_t cut = bytes;
+	for(auto& it : groups){
+		if(it.second.written){
+			cut = std::min(cut, it.second.offset);
+		}
+	}
+	
+	// Start from the empty journal when nothing could be rolled back
+	if(cut == bytes){
+		file = nullptr;
+		DBFS::remove(JOURNAL_FILE);
+		open();
+		return;
+	}
+	
+	// Copying the tail is worth only if most of the journal is dropped
+	if(cut < bytes / 2){
+		return;
+	}
+	
+	string tail(bytes - cut, '\0');
+	file->seekg(cut);
+	file->read(&tail[0], tail.size());
+	
+	string next = JOURNAL_FILE + "_next";
+	DBFS::File* f = new DBFS::File(next);
+	f->write(tail);
+	f->stream().flush();
+	bool fail = f->fail() || file->fail();
+	delete f;
+	
+	if(fail){
+		// Journal stays as it is, it is only longer than needed
+		L_ERR("[Journal::compact]-(cannot write file)");
+		DBFS::remove(next);
+		return;
+	}
+	
+	file = nullptr;
+	DBFS::remove(JOURNAL_FILE);
+	DBFS::move(next, JOURNAL_FILE);
+	open();
+	bytes = tail.size();
+	for(auto& it : groups){
+		if(it.second.written){
+			it.second.offset -= cut;
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef FOREST_JOURNAL_H
+#define FOREST_JOURNAL_H
+
+#include <map>
+#include <vector>
+#include <functional>
+#include <sstream>
+#include <unordered_map>
+#include <condition_variable>
+#include "dbutils.hpp"
+#include "variables.hpp"
+
+namespace forest{
+namespace details{
+
+	// Undo journal of node files replaced by the Savior.
+	// Nodes changed together (split, join, new root) are published as
+	// one group: a record is written before every file is replaced and the
+	// previous version is kept until the group commits. Groups found
+	// uncommitted at bloom are rolled back to the previous versions.
+	// A file replaced by a group stays pinned to it until it commits.
+	// A group replacing a pinned file, or depending on a file another group
+	// is saving, is joined with that group. Joined groups commit and roll
+	// back together.
+	class Journal{
+
+		struct record_t{
+			string target;
+			string backup;
+			string temp;
+		};
+		
+		struct group_state_t{
+			uint_t parent;
+			bool committed = false;
+			bool written = false;
+			uint_t offset = 0;
+			std::vector<string> targets;
+			std::vector<std::function<void()>> on_commit;
+		};
+
+		public:
+			using group_t = uint_t;
+
+			Journal();
+			virtual ~Journal();
+			group_t begin();
+			void record(group_t group, const string& target, const string& backup, const string& temp);
+			void attach(group_t group, const string& target);
+			void join(group_t group, group_t other);
+			void commit(group_t group, std::vector<std::function<void()>> on_commit);
+			void sync();
+
+		private:
+			void recover();
+			void rollback(std::vector<record_t>& records);
+			void open();
+			void write(group_t group, const string& data);
+			void unite(group_t group, group_t other);
+			group_t find(group_t group);
+			void compact();
+
+			file_ptr file;
+			uint_t bytes = 0;
+			group_t next_group = 1;
+			std::map<group_t, group_state_t> groups;
+			std::unordered_map<string, group_t> pins;
+			mutex mtx;
+			std::condition_variable cv;
+	};
+
+	extern Journal* journal;
+
+} // details
+} // forest
+
+#endif // FOREST_JOURNAL_H
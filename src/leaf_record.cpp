@@ -29,12 +29,14 @@ bool forest::details::LeafRecord::eof()
 
 bool forest::details::LeafRecord::move_forward()
 {
+	latency_timer timer(metrics.scan);
 	++it;
 	return !eof();
 }
 
 bool forest::details::LeafRecord::move_back()
 {
+	latency_timer timer(metrics.scan);
 	--it;
 	return !eof();
 }
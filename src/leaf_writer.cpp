@@ -0,0 +1,92 @@
+#include "leaf_writer.hpp"
+#include "savior.hpp"
+#include "tree.hpp"
+#include "value_log.hpp"
+#include "crc32c.hpp"
+#include "variables.hpp"
+
+
+forest::details::leaf_writer::leaf_writer() : segment(-1), length(0), crc(0), summed(VALUE_CHECKSUMS), finished(false)
+{
+	if(VALUE_LOG_THRESHOLD > 0){
+		auto stream = value_log->open_stream();
+		segment = stream.first;
+		file = stream.second;
+		int_t id = segment;
+		file->on_close([id](DBFS::File* file){
+			if(value_log){
+				value_log->close_stream(id);
+			}
+		});
+		return;
+	}
+	
+	file = file_ptr(DBFS::create());
+	if(file->fail()){
+		L_ERR("[leaf_writer::leaf_writer]-(cannot create file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_CREATE_FILE);
+	}
+	file->on_close([](DBFS::File* file){ savior->remove_file_async(file->name()); });
+}
+
+forest::details::leaf_writer::~leaf_writer()
+{
+	// dtor
+}
+
+void forest::details::leaf_writer::write(const char* buffer, uint_t length)
+{
+	std::lock_guard<mutex> lock(mtx);
+	if(finished){
+		throw TreeException(TreeException::ERRORS::BAD_INPUT_PARAMETER);
+	}
+	
+	{
+		auto f_lock = file->get_lock();
+		file->seekp(this->length);
+		file->write(buffer, length);
+		if(file->fail()){
+			L_ERR("[leaf_writer::write]-(cannot write file)");
+			throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+		}
+	}
+	this->length += length;
+	if(summed){
+		crc = crc32c(crc, buffer, length);
+	}
+}
+
+void forest::details::leaf_writer::write(string data)
+{
+	write(data.c_str(), data.size());
+}
+
+forest::details::detached_leaf_ptr forest::details::leaf_writer::finish()
+{
+	std::lock_guard<mutex> lock(mtx);
+	if(finished){
+		throw TreeException(TreeException::ERRORS::BAD_INPUT_PARAMETER);
+	}
+	finished = true;
+	
+	{
+		auto f_lock = file->get_lock();
+		file->stream().flush();
+	}
+	
+	file_data_ptr data = file_data_ptr(new file_data_t(file, 0, length));
+	if(segment >= 0){
+		value_log->streamed(segment, length);
+		data->set_segment(segment);
+	}
+	if(summed){
+		data->set_checksum(crc);
+	}
+	return detached_leaf_ptr(new detached_leaf(data));
+}
+
+forest::details::uint_t forest::details::leaf_writer::size()
+{
+	std::lock_guard<mutex> lock(mtx);
+	return length;
+}
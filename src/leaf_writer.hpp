@@ -0,0 +1,39 @@
+#ifndef FOREST_LEAF_WRITER_H
+#define FOREST_LEAF_WRITER_H
+
+#include "dbutils.hpp"
+#include "detached_leaf.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Streams value of unknown length into a temporary leaf file
+	// chunk by chunk, so the value is never held in memory. With the
+	// value log on, the value is streamed into a segment of its own
+	// and leafs keep only the pointer to it
+	class leaf_writer{
+		
+		public:
+			leaf_writer();
+			virtual ~leaf_writer();
+			void write(const char* buffer, uint_t length);
+			void write(string data);
+			detached_leaf_ptr finish();
+			uint_t size();
+			
+		private:
+			file_ptr file;
+			int_t segment;
+			uint_t length;
+			uint32_t crc;
+			bool summed;
+			bool finished;
+			mutex mtx;
+	};
+	
+	using leaf_writer_ptr = std::shared_ptr<leaf_writer>;
+	
+} // details
+} // forest
+
+#endif // FOREST_LEAF_WRITER_H
@@ -26,6 +26,8 @@ class ListCache{
 		T& get(Key& key);
 		item_t& back();
 		item_t& front();
+		list_t_iterator begin();
+		list_t_iterator end();
 		bool has(Key& key);
 		void push(item_t val);
 		void push(Key key, T val);
@@ -116,6 +118,18 @@ typename ListCache<Key, T>::item_t& ListCache<Key, T>::front()
 	return list.front();
 }
 
+template<typename Key, typename T>
+typename ListCache<Key, T>::list_t_iterator ListCache<Key, T>::begin()
+{
+	return list.begin();
+}
+
+template<typename Key, typename T>
+typename ListCache<Key, T>::list_t_iterator ListCache<Key, T>::end()
+{
+	return list.end();
+}
+
 template<typename Key, typename T>
 void ListCache<Key, T>::remove(Key& key)
 {
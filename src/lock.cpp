@@ -1,7 +1,7 @@
 #include "lock.hpp"
 
 
-void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& c_node, bool w_prior)
+void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& c_node, bool w_prior, const char* site)
 {
 	// quick-access
 	auto& ch_node = get_data(node).change_locks;
@@ -23,7 +23,12 @@ void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr
 	}
 	
 	// Lock
+	auto since = lock_profiler::active() ? lock_profiler::clock::now() : lock_profiler::clock::time_point();
 	std::lock(ch_node.m, ch_shift_node.m);
+	if(lock_profiler::active()){
+		lock_profiler::acquired(LOCK_CLASS::CHANGE, &ch_node, site, since);
+		lock_profiler::acquired(LOCK_CLASS::CHANGE, &ch_shift_node, site, since);
+	}
 	
 	if(w_prior){
 		// Priority lock
@@ -45,7 +50,7 @@ void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr
 	}
 }
 
-void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& m_node, tree_t::node_ptr& c_node, bool w_prior)
+void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& m_node, tree_t::node_ptr& c_node, bool w_prior, const char* site)
 {
 	// quick-access
 	auto& ch_node = get_data(node).change_locks;
@@ -71,7 +76,13 @@ void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr
 	}
 	
 	// Lock nodes
+	auto since = lock_profiler::active() ? lock_profiler::clock::now() : lock_profiler::clock::time_point();
 	std::lock(ch_node.m, ch_new_node.m, ch_link_node.m);
+	if(lock_profiler::active()){
+		lock_profiler::acquired(LOCK_CLASS::CHANGE, &ch_node, site, since);
+		lock_profiler::acquired(LOCK_CLASS::CHANGE, &ch_new_node, site, since);
+		lock_profiler::acquired(LOCK_CLASS::CHANGE, &ch_link_node, site, since);
+	}
 	
 	if(w_prior){
 		// Priority lock
@@ -97,7 +108,7 @@ void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr
 	}
 }
 
-void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::child_item_type_ptr& item, bool w_prior)
+void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::child_item_type_ptr& item, bool w_prior, const char* site)
 {	
 	// Quick-access
 	auto& ch_node = get_data(node).change_locks;
@@ -113,7 +124,12 @@ void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::child_it
 	}
 	
 	// Lock
+	auto since = lock_profiler::active() ? lock_profiler::clock::now() : lock_profiler::clock::time_point();
 	std::lock(item->item->second->m, ch_node.m);
+	if(lock_profiler::active()){
+		lock_profiler::acquired(LOCK_CLASS::ITEM, item->item->second.get(), site, since);
+		lock_profiler::acquired(LOCK_CLASS::CHANGE, &ch_node, site, since);
+	}
 	
 	// Notify
 	if(w_prior){
@@ -127,21 +143,23 @@ void forest::details::change_lock_bunch(tree_t::node_ptr& node, tree_t::child_it
 	}
 }
 
-void forest::details::change_lock_read(tree_t::node_ptr& node)
+void forest::details::change_lock_read(tree_t::node_ptr& node, const char* site)
 {
-	change_lock_read(node.get());
+	change_lock_read(node.get(), site);
 }
 
-void forest::details::change_lock_read(tree_t::Node* node)
+void forest::details::change_lock_read(tree_t::Node* node, const char* site)
 {
 	auto& ch_node = get_data(node).change_locks;
-	std::unique_lock<std::mutex> lock(ch_node.g);
-	while(ch_node.promote){
-		ch_node.p_cond.wait(lock);
-	}
-	if(ch_node.c++ == 0){
-		ch_node.m.lock();
-	}
+	lock_profiler::acquire(LOCK_CLASS::CHANGE, &ch_node, site, [&ch_node]{
+		std::unique_lock<std::mutex> lock(ch_node.g);
+		while(ch_node.promote){
+			ch_node.p_cond.wait(lock);
+		}
+		if(ch_node.c++ == 0){
+			ch_node.m.lock();
+		}
+	});
 }
 
 void forest::details::change_unlock_read(tree_t::node_ptr& node)
@@ -152,6 +170,7 @@ void forest::details::change_unlock_read(tree_t::node_ptr& node)
 void forest::details::change_unlock_read(tree_t::Node* node)
 {
 	auto& ch_node = get_data(node).change_locks;
+	lock_profiler::release(&ch_node);
 	ch_node.g.lock();
 	if(--ch_node.c == 0){
 		ch_node.m.unlock();
@@ -163,26 +182,30 @@ void forest::details::change_unlock_read(tree_t::Node* node)
 	ch_node.g.unlock();
 }
 
-void forest::details::change_lock_promote(tree_t::node_ptr& node)
+void forest::details::change_lock_promote(tree_t::node_ptr& node, const char* site)
 {
-	change_lock_promote(node.get());
+	change_lock_promote(node.get(), site);
 }
 
-void forest::details::change_lock_promote(tree_t::Node* node)
+void forest::details::change_lock_promote(tree_t::Node* node, const char* site)
 {
 	auto& ch_node = get_data(node).change_locks;
-	std::unique_lock<std::mutex> lock(ch_node.g);
-	
-	ASSERT(!ch_node.promote);
 	
-	ch_node.promote = true;
-	while(ch_node.c > 1){
-		ch_node.p_cond.wait(lock);
-	}
-	
-	ASSERT(ch_node.c == 1);
-	
-	--ch_node.c;
-	ch_node.promote = false;
-	ch_node.p_cond.notify_all();
+	// Promoted lock is already held as read, only the wait is counted
+	lock_profiler::acquire(LOCK_CLASS::CHANGE, nullptr, site, [&ch_node]{
+		std::unique_lock<std::mutex> lock(ch_node.g);
+		
+		ASSERT(!ch_node.promote);
+		
+		ch_node.promote = true;
+		while(ch_node.c > 1){
+			ch_node.p_cond.wait(lock);
+		}
+		
+		ASSERT(ch_node.c == 1);
+		
+		--ch_node.c;
+		ch_node.promote = false;
+		ch_node.p_cond.notify_all();
+	});
 }
@@ -2,78 +2,82 @@
 #define FOREST_LOCK_H
 
 #include "dbutils.hpp"
+#include "metrics.hpp"
+#include "lock_profiler.hpp"
 
 namespace forest{
 namespace details{
 
 	// General Lock for Node
-	void lock_read(tree_t::node_ptr& node);
-	void lock_read(tree_t::Node* node);
+	void lock_read(tree_t::node_ptr& node, const char* site = __builtin_FUNCTION());
+	void lock_read(tree_t::Node* node, const char* site = __builtin_FUNCTION());
 	void unlock_read(tree_t::node_ptr& node);
 	void unlock_read(tree_t::Node* node);
-	void lock_write(tree_t::node_ptr& node);
-	void lock_write(tree_t::Node* node);
+	void lock_write(tree_t::node_ptr& node, const char* site = __builtin_FUNCTION());
+	void lock_write(tree_t::Node* node, const char* site = __builtin_FUNCTION());
 	void unlock_write(tree_t::node_ptr& node);
 	void unlock_write(tree_t::Node* node);
-	void lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type);
-	void lock_type(tree_t::Node* node, tree_t::PROCESS_TYPE type);
+	void lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type, const char* site = __builtin_FUNCTION());
+	void lock_type(tree_t::Node* node, tree_t::PROCESS_TYPE type, const char* site = __builtin_FUNCTION());
 	void unlock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type);
 	void unlock_type(tree_t::Node* node, tree_t::PROCESS_TYPE type);
 	bool is_write_locked(tree_t::node_ptr& node);
 	
 	// General Lock for Item
-	void lock_read(tree_t::child_item_type_ptr& item);
+	void lock_read(tree_t::child_item_type_ptr& item, const char* site = __builtin_FUNCTION());
 	void unlock_read(tree_t::child_item_type_ptr& item);
-	void lock_write(tree_t::child_item_type_ptr& item);
+	void lock_write(tree_t::child_item_type_ptr& item, const char* site = __builtin_FUNCTION());
 	void unlock_write(tree_t::child_item_type_ptr& item);
-	void lock_type(tree_t::child_item_type_ptr& item, tree_t::PROCESS_TYPE type);
+	void lock_type(tree_t::child_item_type_ptr& item, tree_t::PROCESS_TYPE type, const char* site = __builtin_FUNCTION());
 	void unlock_type(tree_t::child_item_type_ptr& item, tree_t::PROCESS_TYPE type);
 	
 	// Bunch lock
-	void change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& c_node, bool w_prior=false);
-	void change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& m_node, tree_t::node_ptr& c_node, bool w_prior=false);
-	void change_lock_bunch(tree_t::node_ptr& node, tree_t::child_item_type_ptr& item, bool w_prior=false);
+	void change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& c_node, bool w_prior=false, const char* site = __builtin_FUNCTION());
+	void change_lock_bunch(tree_t::node_ptr& node, tree_t::node_ptr& m_node, tree_t::node_ptr& c_node, bool w_prior=false, const char* site = __builtin_FUNCTION());
+	void change_lock_bunch(tree_t::node_ptr& node, tree_t::child_item_type_ptr& item, bool w_prior=false, const char* site = __builtin_FUNCTION());
 	
 	// Own Lock for Node
-	void own_lock(tree_t::node_ptr& node);
+	void own_lock(tree_t::node_ptr& node, const char* site = __builtin_FUNCTION());
 	void own_unlock(tree_t::node_ptr& node);
 	int own_inc(tree_t::node_ptr& node);
 	int own_dec(tree_t::node_ptr& node);
 	
 	// Change Lock for Node
-	void change_lock_read(tree_t::node_ptr& node);
-	void change_lock_read(tree_t::Node* node);
+	void change_lock_read(tree_t::node_ptr& node, const char* site = __builtin_FUNCTION());
+	void change_lock_read(tree_t::Node* node, const char* site = __builtin_FUNCTION());
 	void change_unlock_read(tree_t::node_ptr& node);
 	void change_unlock_read(tree_t::Node* node);
-	void change_lock_write(tree_t::node_ptr& node);
-	void change_lock_write(tree_t::Node* node);
+	void change_lock_write(tree_t::node_ptr& node, const char* site = __builtin_FUNCTION());
+	void change_lock_write(tree_t::Node* node, const char* site = __builtin_FUNCTION());
 	void change_unlock_write(tree_t::node_ptr& node);
 	void change_unlock_write(tree_t::Node* node);
-	void change_lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type);
+	void change_lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type, const char* site = __builtin_FUNCTION());
 	void change_unlock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type);
-	void change_lock_promote(tree_t::node_ptr& node);
-	void change_lock_promote(tree_t::Node* node);
+	void change_lock_promote(tree_t::node_ptr& node, const char* site = __builtin_FUNCTION());
+	void change_lock_promote(tree_t::Node* node, const char* site = __builtin_FUNCTION());
 	
 } // details
 } // forest
 
 
 
-inline void forest::details::lock_read(tree_t::node_ptr& node)
+inline void forest::details::lock_read(tree_t::node_ptr& node, const char* site)
 {
-	lock_read(node.get());
+	lock_read(node.get(), site);
 }
 
-inline void forest::details::lock_read(tree_t::Node* node)
+inline void forest::details::lock_read(tree_t::Node* node, const char* site)
 {
 	//return;
 	auto& tl = get_data(node).travel_locks;
 	
-	tl.m.lock();
-	if(tl.c++ == 0){
-		tl.g.lock();
-	}
-	tl.m.unlock();
+	lock_profiler::acquire(LOCK_CLASS::TRAVEL, &tl, site, [&tl]{
+		tl.m.lock();
+		if(tl.c++ == 0){
+			tl.g.lock();
+		}
+		tl.m.unlock();
+	});
 }
 
 inline void forest::details::unlock_read(tree_t::node_ptr& node)
@@ -86,6 +90,7 @@ inline void forest::details::unlock_read(tree_t::Node* node)
 	//return;
 	auto& tl = get_data(node).travel_locks;
 	
+	lock_profiler::release(&tl);
 	tl.m.lock();
 	if(--tl.c == 0){
 		tl.g.unlock();
@@ -93,17 +98,19 @@ inline void forest::details::unlock_read(tree_t::Node* node)
 	tl.m.unlock();
 }
 
-inline void forest::details::lock_write(tree_t::node_ptr& node)
+inline void forest::details::lock_write(tree_t::node_ptr& node, const char* site)
 {
-	lock_write(node.get());
+	lock_write(node.get(), site);
 }
 
-inline void forest::details::lock_write(tree_t::Node* node)
+inline void forest::details::lock_write(tree_t::Node* node, const char* site)
 {
 	//return;
 	auto& tl = get_data(node).travel_locks;
 	
-	tl.g.lock();
+	lock_profiler::acquire(LOCK_CLASS::TRAVEL, &tl, site, [&tl]{
+		timed_lock(tl.g, metrics.lock_wait);
+	});
 	tl.wlock = true;
 }
 
@@ -117,18 +124,19 @@ inline void forest::details::unlock_write(tree_t::Node* node)
 	//return;
 	auto& tl = get_data(node).travel_locks;
 	
+	lock_profiler::release(&tl);
 	tl.wlock = false;
 	tl.g.unlock();
 }
 
-inline void forest::details::lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type)
+inline void forest::details::lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type, const char* site)
 {
-	lock_type(node.get(), type);
+	lock_type(node.get(), type, site);
 }
 
-inline void forest::details::lock_type(tree_t::Node* node, tree_t::PROCESS_TYPE type)
+inline void forest::details::lock_type(tree_t::Node* node, tree_t::PROCESS_TYPE type, const char* site)
 {
-	(type == tree_t::PROCESS_TYPE::WRITE) ? lock_write(node) : lock_read(node);
+	(type == tree_t::PROCESS_TYPE::WRITE) ? lock_write(node, site) : lock_read(node, site);
 }
 
 inline void forest::details::unlock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type)
@@ -146,19 +154,22 @@ inline bool forest::details::is_write_locked(tree_t::node_ptr& node)
 	return get_data(node).travel_locks.wlock;
 }
 
-inline void forest::details::lock_read(tree_t::child_item_type_ptr& item)
+inline void forest::details::lock_read(tree_t::child_item_type_ptr& item, const char* site)
 {
 	auto& it = item->item->second;
-	it->g.lock();
-	if(it->c++ == 0){
-		it->m.lock();
-	}
-	it->g.unlock();
+	lock_profiler::acquire(LOCK_CLASS::ITEM, it.get(), site, [&it]{
+		it->g.lock();
+		if(it->c++ == 0){
+			it->m.lock();
+		}
+		it->g.unlock();
+	});
 }
 
 inline void forest::details::unlock_read(tree_t::child_item_type_ptr& item)
 {
 	auto& it = item->item->second;
+	lock_profiler::release(it.get());
 	it->g.lock();
 	if(--it->c == 0){
 		it->m.unlock();
@@ -166,19 +177,23 @@ inline void forest::details::unlock_read(tree_t::child_item_type_ptr& item)
 	it->g.unlock();
 }
 
-inline void forest::details::lock_write(tree_t::child_item_type_ptr& item)
+inline void forest::details::lock_write(tree_t::child_item_type_ptr& item, const char* site)
 {
-	item->item->second->m.lock();
+	auto& it = item->item->second;
+	lock_profiler::acquire(LOCK_CLASS::ITEM, it.get(), site, [&it]{
+		it->m.lock();
+	});
 }
 
 inline void forest::details::unlock_write(tree_t::child_item_type_ptr& item)
 {
+	lock_profiler::release(item->item->second.get());
 	item->item->second->m.unlock();
 }
 
-inline void forest::details::lock_type(tree_t::child_item_type_ptr& item, tree_t::PROCESS_TYPE type)
+inline void forest::details::lock_type(tree_t::child_item_type_ptr& item, tree_t::PROCESS_TYPE type, const char* site)
 {
-	(type == tree_t::PROCESS_TYPE::WRITE) ? lock_write(item) : lock_read(item);
+	(type == tree_t::PROCESS_TYPE::WRITE) ? lock_write(item, site) : lock_read(item, site);
 }
 
 inline void forest::details::unlock_type(tree_t::child_item_type_ptr& item, tree_t::PROCESS_TYPE type)
@@ -186,14 +201,19 @@ inline void forest::details::unlock_type(tree_t::child_item_type_ptr& item, tree
 	(type == tree_t::PROCESS_TYPE::WRITE) ? unlock_write(item) : unlock_read(item);
 }
 
-inline void forest::details::own_lock(tree_t::node_ptr& node)
+inline void forest::details::own_lock(tree_t::node_ptr& node, const char* site)
 {
-	get_data(node).owner_locks.m.lock();
+	auto& ol = get_data(node).owner_locks;
+	lock_profiler::acquire(LOCK_CLASS::OWNER, &ol, site, [&ol]{
+		ol.m.lock();
+	});
 }
 
 inline void forest::details::own_unlock(tree_t::node_ptr& node)
 {
-	get_data(node).owner_locks.m.unlock();
+	auto& ol = get_data(node).owner_locks;
+	lock_profiler::release(&ol);
+	ol.m.unlock();
 }
 
 inline int forest::details::own_inc(tree_t::node_ptr& node)
@@ -207,14 +227,17 @@ inline int forest::details::own_dec(tree_t::node_ptr& node)
 	return --get_data(node).owner_locks.c;
 }
 
-inline void forest::details::change_lock_write(tree_t::node_ptr& node)
+inline void forest::details::change_lock_write(tree_t::node_ptr& node, const char* site)
 {
-	change_lock_write(node.get());
+	change_lock_write(node.get(), site);
 }
 
-inline void forest::details::change_lock_write(tree_t::Node* node)
+inline void forest::details::change_lock_write(tree_t::Node* node, const char* site)
 {
-	get_data(node).change_locks.m.lock();
+	auto& ch = get_data(node).change_locks;
+	lock_profiler::acquire(LOCK_CLASS::CHANGE, &ch, site, [&ch]{
+		timed_lock(ch.m, metrics.lock_wait);
+	});
 }
 
 inline void forest::details::change_unlock_write(tree_t::node_ptr& node)
@@ -224,12 +247,14 @@ inline void forest::details::change_unlock_write(tree_t::node_ptr& node)
 
 inline void forest::details::change_unlock_write(tree_t::Node* node)
 {
-	get_data(node).change_locks.m.unlock();
+	auto& ch = get_data(node).change_locks;
+	lock_profiler::release(&ch);
+	ch.m.unlock();
 }
 
-inline void forest::details::change_lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type)
+inline void forest::details::change_lock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type, const char* site)
 {
-	(type == tree_t::PROCESS_TYPE::WRITE) ? change_lock_write(node) : change_lock_read(node);
+	(type == tree_t::PROCESS_TYPE::WRITE) ? change_lock_write(node, site) : change_lock_read(node, site);
 }
 
 inline void forest::details::change_unlock_type(tree_t::node_ptr& node, tree_t::PROCESS_TYPE type)
@@ -0,0 +1,169 @@
+#include "lock_profiler.hpp"
+
+namespace forest{
+namespace details{
+namespace lock_profiler{
+
+	std::atomic<bool> enabled = false;
+	std::atomic<uint_t> generation = 0;
+	
+	// Thread holds a few locks at once, the rest of this many entries
+	// are locks released by other threads
+	const std::size_t HELD_LIMIT = 256;
+	
+	struct site_stats_t{
+		LOCK_CLASS cls;
+		const char* site;
+		std::atomic<uint_t> count = 0;
+		std::atomic<uint_t> wait_ns = 0;
+		std::atomic<uint_t> hold_ns = 0;
+	};
+	
+	struct held_t{
+		site_stats_t* stats;
+		clock::time_point since;
+	};
+	
+	using site_key = std::pair<int, const char*>;
+	
+	struct site_hash{
+		std::size_t operator()(const site_key& key) const
+		{
+			return std::hash<const char*>()(key.second) * 31 + key.first;
+		}
+	};
+	
+	// Stats are never freed, threads keep pointers to them
+	std::unordered_map<site_key, site_stats_t*, site_hash> sites;
+	std::mutex sites_m;
+	
+	thread_local std::unordered_map<site_key, site_stats_t*, site_hash> local_sites;
+	thread_local std::unordered_multimap<const void*, held_t> held;
+	thread_local uint_t held_generation = 0;
+	
+	const char* class_names[] = {"travel", "owner", "change", "item", "tree_cache", "intr_cache", "leaf_cache", "savior_map"};
+	
+	site_stats_t* get_site(LOCK_CLASS cls, const char* site)
+	{
+		site_key key((int)cls, site);
+		auto it = local_sites.find(key);
+		if(it != local_sites.end()){
+			return it->second;
+		}
+		
+		std::lock_guard<std::mutex> lock(sites_m);
+		site_stats_t*& stats = sites[key];
+		if(!stats){
+			stats = new site_stats_t();
+			stats->cls = cls;
+			stats->site = site;
+		}
+		local_sites[key] = stats;
+		return stats;
+	}
+	
+	std::unordered_multimap<const void*, held_t>& held_locks()
+	{
+		// Releases are not seen while profiling is off, so locks taken
+		// before it was switched are forgotten
+		uint_t gen = generation.load(std::memory_order_relaxed);
+		if(held_generation != gen){
+			held.clear();
+			held_generation = gen;
+		}
+		return held;
+	}
+
+} // lock_profiler
+} // details
+} // forest
+
+
+void forest::details::lock_profiler::enable(bool enabled)
+{
+	lock_profiler::enabled = enabled;
+	generation.fetch_add(1);
+}
+
+void forest::details::lock_profiler::acquired(LOCK_CLASS cls, const void* lock, const char* site, clock::time_point since)
+{
+	auto now = clock::now();
+	site_stats_t* stats = get_site(cls, site);
+	stats->count.fetch_add(1, std::memory_order_relaxed);
+	stats->wait_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - since).count(), std::memory_order_relaxed);
+	
+	// Hold time is known only for locks released by the same thread
+	if(lock){
+		auto& locks = held_locks();
+		if(locks.size() >= HELD_LIMIT){
+			locks.clear();
+		}
+		locks.emplace(lock, held_t{stats, now});
+	}
+}
+
+void forest::details::lock_profiler::released(const void* lock)
+{
+	auto& locks = held_locks();
+	auto it = locks.find(lock);
+	if(it == locks.end()){
+		return;
+	}
+	it->second.stats->hold_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - it->second.since).count(), std::memory_order_relaxed);
+	locks.erase(it);
+}
+
+std::vector<forest::details::lock_stats_t> forest::details::lock_profiler::report()
+{
+	// The same function may be seen under different pointers
+	std::map<std::pair<int, string>, lock_stats_t> merged;
+	{
+		std::lock_guard<std::mutex> lock(sites_m);
+		for(auto& it : sites){
+			site_stats_t* s = it.second;
+			lock_stats_t& r = merged[std::make_pair((int)s->cls, string(s->site))];
+			r.lock = class_names[(int)s->cls];
+			r.site = s->site;
+			r.count += s->count.load(std::memory_order_relaxed);
+			r.wait_ns += s->wait_ns.load(std::memory_order_relaxed);
+			r.hold_ns += s->hold_ns.load(std::memory_order_relaxed);
+		}
+	}
+	
+	std::vector<lock_stats_t> res;
+	for(auto& it : merged){
+		if(it.second.count){
+			res.push_back(it.second);
+		}
+	}
+	
+	// The hottest lock is the one threads waited for the longest
+	std::sort(res.begin(), res.end(), [](const lock_stats_t& a, const lock_stats_t& b){
+		return a.wait_ns != b.wait_ns ? a.wait_ns > b.wait_ns : a.hold_ns > b.hold_ns;
+	});
+	return res;
+}
+
+forest::details::string forest::details::lock_profiler::report_text(int limit)
+{
+	std::ostringstream out;
+	out << std::left << std::setw(12) << "lock" << std::setw(28) << "site" << std::right << std::setw(12) << "count" << std::setw(14) << "wait_us" << std::setw(14) << "hold_us" << std::setw(12) << "avg_wait_ns" << "\n";
+	int i = 0;
+	for(auto& it : report()){
+		if(limit > 0 && i++ >= limit){
+			break;
+		}
+		out << std::left << std::setw(12) << it.lock << std::setw(28) << it.site << std::right << std::setw(12) << it.count << std::setw(14) << it.wait_ns / 1000 << std::setw(14) << it.hold_ns / 1000 << std::setw(12) << it.wait_ns / it.count << "\n";
+	}
+	return out.str();
+}
+
+void forest::details::lock_profiler::reset()
+{
+	std::lock_guard<std::mutex> lock(sites_m);
+	for(auto& it : sites){
+		it.second->count = 0;
+		it.second->wait_ns = 0;
+		it.second->hold_ns = 0;
+	}
+}
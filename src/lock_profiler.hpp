@@ -0,0 +1,117 @@
+#ifndef FOREST_LOCK_PROFILER_H
+#define FOREST_LOCK_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "dbutils.hpp"
+
+namespace forest{
+namespace details{
+
+	enum class LOCK_CLASS{ TRAVEL, OWNER, CHANGE, ITEM, TREE_CACHE, INTR_CACHE, LEAF_CACHE, SAVIOR_MAP };
+	
+	struct lock_stats_t{
+		string lock;
+		string site;
+		uint_t count = 0;
+		uint_t wait_ns = 0;
+		uint_t hold_ns = 0;
+	};
+	
+	// Opt-in contention profiling. Every lock taken while it is on is counted
+	// by the lock class and the function that took it, with the time spent
+	// waiting for it and holding it. While it is off, a lock costs one more
+	// relaxed load.
+	namespace lock_profiler{
+		
+		using clock = std::chrono::steady_clock;
+		
+		bool active();
+		void enable(bool enabled);
+		template<typename T>
+		void acquire(LOCK_CLASS cls, const void* lock, const char* site, T fn);
+		void acquired(LOCK_CLASS cls, const void* lock, const char* site, clock::time_point since);
+		void release(const void* lock);
+		void released(const void* lock);
+		std::vector<lock_stats_t> report();
+		string report_text(int limit);
+		void reset();
+		
+		extern std::atomic<bool> enabled;
+	}
+	
+	// Mutex which reports itself to the profiler
+	class profiled_mutex{
+		public:
+			profiled_mutex(LOCK_CLASS cls);
+			void lock(const char* site = __builtin_FUNCTION());
+			bool try_lock();
+			void unlock();
+			std::unique_lock<profiled_mutex> hold(const char* site = __builtin_FUNCTION());
+		
+		private:
+			LOCK_CLASS cls;
+			std::mutex m;
+	};
+
+} // details
+} // forest
+
+
+inline bool forest::details::lock_profiler::active()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+inline void forest::details::lock_profiler::acquire(LOCK_CLASS cls, const void* lock, const char* site, T fn)
+{
+	if(!active()){
+		fn();
+		return;
+	}
+	auto since = clock::now();
+	fn();
+	acquired(cls, lock, site, since);
+}
+
+inline void forest::details::lock_profiler::release(const void* lock)
+{
+	if(active()){
+		released(lock);
+	}
+}
+
+inline forest::details::profiled_mutex::profiled_mutex(LOCK_CLASS cls) : cls(cls)
+{
+	// ctor
+}
+
+inline void forest::details::profiled_mutex::lock(const char* site)
+{
+	lock_profiler::acquire(cls, this, site, [this]{ m.lock(); });
+}
+
+inline bool forest::details::profiled_mutex::try_lock()
+{
+	return m.try_lock();
+}
+
+inline void forest::details::profiled_mutex::unlock()
+{
+	lock_profiler::release(this);
+	m.unlock();
+}
+
+inline std::unique_lock<forest::details::profiled_mutex> forest::details::profiled_mutex::hold(const char* site)
+{
+	lock(site);
+	return std::unique_lock<profiled_mutex>(*this, std::adopt_lock);
+}
+
+#endif // FOREST_LOCK_PROFILER_H
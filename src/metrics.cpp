@@ -0,0 +1,149 @@
+#include "metrics.hpp"
+
+namespace forest{
+namespace details{
+
+	Metrics metrics;
+
+} // details
+} // forest
+
+
+// histogram
+forest::details::histogram::histogram() : shards(new shard_t[SHARDS])
+{
+	// ctor
+}
+
+forest::details::histogram_t forest::details::histogram::snapshot()
+{
+	histogram_t res;
+	std::vector<uint_t> counts(BUCKETS, 0);
+	for(int i=0;i<SHARDS;i++){
+		for(int b=0;b<BUCKETS;b++){
+			counts[b] += shards[i].buckets[b].load(std::memory_order_relaxed);
+		}
+		res.sum += shards[i].sum.load(std::memory_order_relaxed);
+		res.max = std::max(res.max, shards[i].max.load(std::memory_order_relaxed));
+	}
+	for(int b=0;b<BUCKETS;b++){
+		if(counts[b]){
+			res.count += counts[b];
+			res.buckets.push_back(std::make_pair(std::min(upper_bound(b), res.max), counts[b]));
+		}
+	}
+	
+	// Percentile is the upper bound of the bucket it falls into
+	auto percentile = [&res](double q){
+		uint_t rank = std::max((uint_t)1, (uint_t)(q * res.count + 0.5));
+		uint_t seen = 0;
+		for(auto& it : res.buckets){
+			seen += it.second;
+			if(seen >= rank){
+				return it.first;
+			}
+		}
+		return res.max;
+	};
+	if(res.count){
+		res.p50 = percentile(0.5);
+		res.p90 = percentile(0.9);
+		res.p99 = percentile(0.99);
+		res.p999 = percentile(0.999);
+	}
+	return res;
+}
+
+forest::details::uint_t forest::details::histogram::upper_bound(int bucket)
+{
+	if(bucket < LINEAR){
+		return bucket;
+	}
+	int shift = (bucket - LINEAR) / SUB_COUNT + 1;
+	uint_t sub = (bucket - LINEAR) % SUB_COUNT;
+	return ((SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+
+// Metrics
+forest::details::metrics_t forest::details::Metrics::snapshot()
+{
+	metrics_t m;
+	m.find = find.snapshot();
+	m.insert = insert.snapshot();
+	m.erase = erase.snapshot();
+	m.scan = scan.snapshot();
+	m.node_load = node_load.snapshot();
+	m.save = save.snapshot();
+	m.lock_wait = lock_wait.snapshot();
+	m.tree_cache_hits = tree_cache_hits.get();
+	m.tree_cache_misses = tree_cache_misses.get();
+	m.intr_cache_hits = intr_cache_hits.get();
+	m.intr_cache_misses = intr_cache_misses.get();
+	m.leaf_cache_hits = leaf_cache_hits.get();
+	m.leaf_cache_misses = leaf_cache_misses.get();
+	m.value_cache_hits = value_cache_hits.get();
+	m.value_cache_misses = value_cache_misses.get();
+	return m;
+}
+
+forest::details::string forest::details::prometheus_text(const metrics_t& m)
+{
+	std::ostringstream out;
+	
+	// Latencies are exported as summaries in seconds
+	auto summary = [&out](const string& name, const string& help, const histogram_t& h){
+		string metric = "forest_" + name + "_seconds";
+		out << "# HELP " << metric << " " << help << "\n";
+		out << "# TYPE " << metric << " summary\n";
+		std::pair<const char*, uint_t> quantiles[] = {{"0.5", h.p50}, {"0.9", h.p90}, {"0.99", h.p99}, {"0.999", h.p999}};
+		for(auto& q : quantiles){
+			out << metric << "{quantile=\"" << q.first << "\"} " << q.second / 1e9 << "\n";
+		}
+		out << metric << "_sum " << h.sum / 1e9 << "\n";
+		out << metric << "_count " << h.count << "\n";
+	};
+	summary("find", "Latency of finding a leaf by key", m.find);
+	summary("insert", "Latency of inserting or updating a leaf", m.insert);
+	summary("erase", "Latency of removing a leaf", m.erase);
+	summary("scan", "Latency of moving a leaf to the next or previous one", m.scan);
+	summary("node_load", "Latency of reading a node from its file", m.node_load);
+	summary("save", "Latency of saving a node", m.save);
+	summary("lock_wait", "Time spent waiting for taken locks", m.lock_wait);
+	
+	std::pair<const char*, std::pair<uint_t, uint_t>> caches[] = {
+		{"tree", {m.tree_cache_hits, m.tree_cache_misses}},
+		{"intr", {m.intr_cache_hits, m.intr_cache_misses}},
+		{"leaf", {m.leaf_cache_hits, m.leaf_cache_misses}},
+		{"value", {m.value_cache_hits, m.value_cache_misses}}
+	};
+	out << "# HELP forest_cache_hits_total Lookups served by the cache\n";
+	out << "# TYPE forest_cache_hits_total counter\n";
+	for(auto& c : caches){
+		out << "forest_cache_hits_total{cache=\"" << c.first << "\"} " << c.second.first << "\n";
+	}
+	out << "# HELP forest_cache_misses_total Lookups missing the cache\n";
+	out << "# TYPE forest_cache_misses_total counter\n";
+	for(auto& c : caches){
+		out << "forest_cache_misses_total{cache=\"" << c.first << "\"} " << c.second.second << "\n";
+	}
+	
+	out << "# HELP forest_save_queue_size Nodes waiting to be saved\n";
+	out << "# TYPE forest_save_queue_size gauge\n";
+	out << "forest_save_queue_size " << m.save_queue_size << "\n";
+	out << "# HELP forest_dirty_bytes Bytes written but not saved yet\n";
+	out << "# TYPE forest_dirty_bytes gauge\n";
+	out << "forest_dirty_bytes " << m.dirty_bytes << "\n";
+	
+	out << "# HELP forest_write_stalls_total Writes slowed down by the save backlog\n";
+	out << "# TYPE forest_write_stalls_total counter\n";
+	out << "forest_write_stalls_total " << m.write_stalls << "\n";
+	out << "# HELP forest_write_stall_seconds_total Time writes were slowed down for\n";
+	out << "# TYPE forest_write_stall_seconds_total counter\n";
+	out << "forest_write_stall_seconds_total " << m.write_stall_mks / 1e6 << "\n";
+	out << "# HELP forest_rejected_writes_total Writes rejected by the save backlog\n";
+	out << "# TYPE forest_rejected_writes_total counter\n";
+	out << "forest_rejected_writes_total " << m.rejected_writes << "\n";
+	
+	return out.str();
+}
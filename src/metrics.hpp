@@ -0,0 +1,162 @@
+#ifndef FOREST_METRICS_H
+#define FOREST_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "dbutils.hpp"
+#include "counter.hpp"
+
+namespace forest{
+namespace details{
+
+	struct histogram_t{
+		uint_t count = 0;
+		uint_t sum = 0;
+		uint_t max = 0;
+		uint_t p50 = 0;
+		uint_t p90 = 0;
+		uint_t p99 = 0;
+		uint_t p999 = 0;
+		// Upper bound of the bucket and the number of values in it
+		std::vector<std::pair<uint_t, uint_t>> buckets;
+	};
+	
+	struct metrics_t{
+		// Latencies in nanoseconds
+		histogram_t find;
+		histogram_t insert;
+		histogram_t erase;
+		histogram_t scan;
+		histogram_t node_load;
+		histogram_t save;
+		histogram_t lock_wait;
+		
+		uint_t tree_cache_hits = 0;
+		uint_t tree_cache_misses = 0;
+		uint_t intr_cache_hits = 0;
+		uint_t intr_cache_misses = 0;
+		uint_t leaf_cache_hits = 0;
+		uint_t leaf_cache_misses = 0;
+		uint_t value_cache_hits = 0;
+		uint_t value_cache_misses = 0;
+		uint_t save_queue_size = 0;
+		uint_t write_stalls = 0;
+		uint_t write_stall_mks = 0;
+		uint_t rejected_writes = 0;
+		uint_t dirty_bytes = 0;
+	};
+	
+	// Latency histogram with buckets growing in powers of two, each split
+	// into 8 equal parts, so a value is kept with 12.5% precision.
+	// Every thread records into its own shard, snapshot sums them up.
+	class histogram{
+		
+		static const int SHARDS = 16;
+		static const int SUB_BITS = 3;
+		static const int SUB_COUNT = 1 << SUB_BITS;
+		static const int LINEAR = SUB_COUNT * 2;
+		static const int BUCKETS = LINEAR + (64 - SUB_BITS - 1) * SUB_COUNT;
+		
+		struct alignas(64) shard_t{
+			std::atomic<uint_t> buckets[BUCKETS] = {};
+			std::atomic<uint_t> sum = 0;
+			std::atomic<uint_t> max = 0;
+		};
+		
+		public:
+			histogram();
+			void record(uint_t value);
+			histogram_t snapshot();
+		
+		private:
+			static int bucket(uint_t value);
+			static uint_t upper_bound(int bucket);
+			static int shard_index();
+			
+			std::unique_ptr<shard_t[]> shards;
+	};
+	
+	// Records the time from its creation to its destruction
+	class latency_timer{
+		public:
+			latency_timer(histogram& h);
+			~latency_timer();
+		
+		private:
+			histogram& h;
+			std::chrono::steady_clock::time_point start;
+	};
+	
+	class Metrics{
+		public:
+			metrics_t snapshot();
+			
+			histogram find, insert, erase, scan, node_load, save, lock_wait;
+			sharded_counter tree_cache_hits, tree_cache_misses;
+			sharded_counter intr_cache_hits, intr_cache_misses;
+			sharded_counter leaf_cache_hits, leaf_cache_misses;
+			sharded_counter value_cache_hits, value_cache_misses;
+	};
+	
+	string prometheus_text(const metrics_t& m);
+	
+	// Waiting for the lock is measured only when it is already taken
+	template<typename T>
+	void timed_lock(T& m, histogram& h);
+	
+	extern Metrics metrics;
+
+} // details
+} // forest
+
+
+inline void forest::details::histogram::record(uint_t value)
+{
+	shard_t& s = shards[shard_index()];
+	s.buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+	s.sum.fetch_add(value, std::memory_order_relaxed);
+	uint_t prev = s.max.load(std::memory_order_relaxed);
+	while(prev < value && !s.max.compare_exchange_weak(prev, value, std::memory_order_relaxed));
+}
+
+inline int forest::details::histogram::bucket(uint_t value)
+{
+	if(value < (uint_t)LINEAR){
+		return value;
+	}
+	int msb = 63 - __builtin_clzll(value);
+	int sub = (value >> (msb - SUB_BITS)) & (SUB_COUNT - 1);
+	return LINEAR + (msb - SUB_BITS - 1) * SUB_COUNT + sub;
+}
+
+inline int forest::details::histogram::shard_index()
+{
+	thread_local int index = std::hash<std::thread::id>()(std::this_thread::get_id()) % SHARDS;
+	return index;
+}
+
+inline forest::details::latency_timer::latency_timer(histogram& h) : h(h), start(std::chrono::steady_clock::now())
+{
+	// ctor
+}
+
+inline forest::details::latency_timer::~latency_timer()
+{
+	h.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+template<typename T>
+inline void forest::details::timed_lock(T& m, histogram& h)
+{
+	if(m.try_lock()){
+		return;
+	}
+	latency_timer t(h);
+	m.lock();
+}
+
+#endif // FOREST_METRICS_H
@@ -40,6 +40,15 @@ namespace details{
 		std::shared_ptr<DBFS::File> f;
 		std::weak_ptr<tree_t::Node> original;
 		
+		// Value log bytes referenced by the saved leaf file
+		std::vector<std::pair<int_t, uint_t>> log_refs;
+		
+		// Compression of the tree the leaf belongs to
+		tree_compression_ptr compression;
+		
+		// Tree the node belongs to, used only to tell trees apart
+		Tree* owner = nullptr;
+		
 		cache::node_cache_ref_t* cached_ref;
 		std::list<node_ptr>::iterator cache_iterator;
 		bool cache_iterator_valid = false;
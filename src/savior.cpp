@@ -4,6 +4,8 @@
 unsigned long int h_blocking = 0;
 #endif
 
+thread_local forest::details::uint_t forest::details::Savior::unqueued = 0;
+
 forest::details::Savior::Savior()
 {
 	items_queue.resize(SAVIOUR_QUEUE_LENGTH);
@@ -19,17 +21,23 @@ forest::details::Savior::~Savior()
 	
 	// Wait workers to finish current work
 	scheduler_worker.wait();
-	joiner.wait();
 	file_deleter.wait();
 	
-	// Just to make sure there is no any threads anymore
+	// Just to make sure there is no any saves anymore
 	wait_for_threads();
 }
 
 void forest::details::Savior::put(save_key item, SAVE_TYPES type, void_shared node)
 {
 	DP_LOG_START(p);
-	std::unique_lock<std::mutex> lock(map_mtx);
+	auto lock = map_mtx.hold();
+	
+	// Bytes of the writes made by this thread go to the leaf they changed
+	if(type == SAVE_TYPES::LEAF && unqueued){
+		item_bytes[item] += unqueued;
+		dirty_bytes += unqueued;
+		unqueued = 0;
+	}
 	
 	if(has(item) && !has_locking(item)){
 		// Just schedule as its going to be saved
@@ -46,7 +54,7 @@ void forest::details::Savior::put(save_key item, SAVE_TYPES type, void_shared no
 void forest::details::Savior::remove(save_key item, SAVE_TYPES type, void_shared node)
 {
 	DP_LOG_START(p);
-	std::unique_lock<std::mutex> lock(map_mtx);
+	auto lock = map_mtx.hold();
 
 	define_item(item, type, ACTION_TYPE::REMOVE, node);
 	schedule_save(item);
@@ -56,7 +64,7 @@ void forest::details::Savior::remove(save_key item, SAVE_TYPES type, void_shared
 void forest::details::Savior::leave(save_key item, SAVE_TYPES type, void_shared nodef)
 {
 	DP_LOG_START(p);
-	std::unique_lock<std::mutex> lock(map_mtx);
+	auto lock = map_mtx.hold();
 	
 	// Implicitly close file if leaf is up to date
 	if(type == SAVE_TYPES::LEAF){
@@ -83,17 +91,37 @@ void forest::details::Savior::save(save_key item, bool sync)
 		save_item(item);
 	} else {
 		join_mtx.lock();
-		thrds.push(std::thread([this](string item){
-			save_item(item);
-		}, item));
+		++async_saves;
 		join_mtx.unlock();
-		joiner.work([this]{ wait_for_threads(); });
+		thread_pool->submit(Thread_pool::PRIORITY::SAVE, [this, item]{
+			save_item(item);
+			std::lock_guard<std::mutex> lock(join_mtx);
+			if(--async_saves == 0){
+				join_cv.notify_all();
+			}
+		});
+	}
+}
+
+void forest::details::Savior::flush()
+{
+	// Items changed later are left to the scheduler, so it ends under
+	// steady writes too
+	std::vector<save_key> items;
+	{
+		auto lock = map_mtx.hold();
+		for(auto& it : map){
+			items.push_back(it.first);
+		}
+	}
+	for(auto& item : items){
+		save(item, true);
 	}
 }
 
 void forest::details::Savior::get(save_key item)
 {
-	std::unique_lock lock(map_mtx);
+	auto lock = map_mtx.hold();
 	while(map.count(item)){
 		cv.wait(lock);
 	}
@@ -101,14 +129,81 @@ void forest::details::Savior::get(save_key item)
 
 int forest::details::Savior::save_queue_size()
 {
-	std::unique_lock lock(map_mtx);
+	auto lock = map_mtx.hold();
 	return items_queue.size();
 }
 
+forest::details::uint_t forest::details::Savior::queued_writes(save_key item)
+{
+	// Writes coalesced into the pending save of the item
+	auto lock = map_mtx.hold();
+	return items_queue.has(item) ? items_queue.get(item).writes : 0;
+}
+
+void forest::details::Savior::throttle(uint_t bytes)
+{
+	double over = overage();
+	if(over > 0){
+		if(SAVE_REJECT_STALLED){
+			++rejected;
+			throw TreeException(TreeException::ERRORS::WRITE_STALLED);
+		}
+		
+		// The further the backlog is over the watermark, the longer the writer waits
+		uint_t delay = std::min(over, 100.0) * WRITE_STALL_MKS;
+		std::this_thread::sleep_for(std::chrono::microseconds(delay));
+		++stalls;
+		stall_mks += delay;
+	}
+	unqueued += bytes;
+}
+
+forest::details::Savior::stall_stats_t forest::details::Savior::stall_stats()
+{
+	stall_stats_t stats;
+	stats.stalls = stalls;
+	stats.stall_mks = stall_mks;
+	stats.rejected = rejected;
+	stats.dirty_bytes = dirty_bytes;
+	stats.pending = pending_items;
+	return stats;
+}
+
+forest::details::Savior::flush_stats_t forest::details::Savior::flush_stats()
+{
+	flush_stats_t stats;
+	stats.rounds = rounds;
+	stats.items = round_items;
+	return stats;
+}
+
+double forest::details::Savior::overage()
+{
+	auto part = [](double value, int low, int high){
+		if(high <= 0){
+			return 0.0;
+		}
+		return (value - low) / std::max(high - low, 1);
+	};
+	double items = pending_items, bytes = dirty_bytes;
+	
+	// Writers are slowed down from the high watermark until the backlog
+	// goes below the low one
+	if((SAVE_HIGH_ITEMS > 0 && items >= SAVE_HIGH_ITEMS) || (SAVE_HIGH_BYTES > 0 && bytes >= SAVE_HIGH_BYTES)){
+		stalling = true;
+	} else if(part(items, SAVE_LOW_ITEMS, SAVE_HIGH_ITEMS) <= 0 && part(bytes, SAVE_LOW_BYTES, SAVE_HIGH_BYTES) <= 0){
+		stalling = false;
+	}
+	if(!stalling){
+		return 0;
+	}
+	return std::max(part(items, SAVE_LOW_ITEMS, SAVE_HIGH_ITEMS), part(bytes, SAVE_LOW_BYTES, SAVE_HIGH_BYTES));
+}
+
 void forest::details::Savior::save_all()
 {
 	while(true){
-		std::unique_lock<std::mutex> lock(map_mtx);
+		auto lock = map_mtx.hold();
 		if(map.size() == 0){
 			while(items_queue.size()){
 				cv.wait(lock);
@@ -143,7 +238,23 @@ void forest::details::Savior::unlock_map()
 
 void forest::details::Savior::save_item(save_key item)
 {
-	std::unique_lock<std::mutex> lock(map_mtx);
+	save_group group;
+	group.items.push_back(item);
+	group.members.insert(item);
+	run_group(group, 1);
+}
+
+void forest::details::Savior::save_item(save_key item, save_group& group, bool pulled)
+{
+	auto lock = map_mtx.hold();
+	
+	// Pulled items saved by others are left to them, waiting for them
+	// could make two groups wait each other. The groups are joined instead,
+	// so linked nodes are still published together
+	if(pulled && saving_items.count(item)){
+		journal->join(group.id, saving_items[item]);
+		return;
+	}
 	
 	// Wait if it already saving
 	while(saving_items.count(item)){
@@ -152,6 +263,10 @@ void forest::details::Savior::save_item(save_key item)
 	
 	// Return if it's already up to date
 	if(!has(item)){
+		// Its latest version could be published by a group not committed yet
+		if(pulled){
+			journal->attach(group.id, item);
+		}
 		cv.notify_all();
 		return;
 	}
@@ -159,98 +274,94 @@ void forest::details::Savior::save_item(save_key item)
 	save_value* it = get_item(item);
 	
 	// Mark item for saving
-	saving_items.insert(item);
+	saving_items[item] = group.id;
 	lock.unlock();
 	
-	if(it->type == SAVE_TYPES::INTR){
-		node_ptr node = std::static_pointer_cast<tree_t::Node>(it->node);
-		
-		// To avoid any deadlocks and RC, lock the node
-		forest::details::lock_write(node);
-		
-		it = lock_item(item);
+	{
+		// Disk is taken before the node, so readers of other nodes go first
+		IOScheduler::ticket io(IOScheduler::IO_CLASS::WRITE);
+		latency_timer timer(metrics.save);
 		
-		if(it->action == ACTION_TYPE::SAVE){
-			DBFS::File* f = DBFS::create();
-			forest::details::Tree::save_intr(node, f);
-			string new_name = f->name();
-			delete f;
+		if(it->type == SAVE_TYPES::INTR){
+			node_ptr node = std::static_pointer_cast<tree_t::Node>(it->node);
 			
-			node_data_ptr data = get_node_data(node);
-			string cur_name = data->path;
+			// To avoid any deadlocks and RC, lock the node
+			forest::details::lock_write(node);
+			
+			it = lock_item(item);
 			
-			DBFS::remove(cur_name);
-			DBFS::move(new_name, cur_name);
-		} else { // REMOVE
-			node_data_ptr data = get_node_data(node);
-			remove_file_async(data->path);
-		}
-		
-		forest::details::unlock_write(node);
-	} else if(it->type == SAVE_TYPES::LEAF){
-		node_ptr node = std::static_pointer_cast<tree_t::Node>(it->node);
-		
-		// To avoid any deadlocks and RC, lock the node
-		change_lock_write(node);
-		
-		it = lock_item(item);
-		
-		if(it->action == ACTION_TYPE::SAVE){
 			node_data_ptr data = get_node_data(node);
-			string cur_name = data->path;
-		
-			file_ptr cur_f = get_data(node).f;
-			if(cur_f){
-				// Update count of opened files to not exceed the limit
-				forest::details::opened_files_inc();
-				auto locked = cur_f->get_lock();
-				cur_f->move(DBFS::random_filename());
+			if(it->action == ACTION_TYPE::SAVE){
+				DBFS::File* f = DBFS::create();
+				io.set_bytes(forest::details::Tree::save_intr(node, f));
+				string new_name = f->name();
+				delete f;
 				
-				// Other could still reference this leaf, so delete file
-				// when no references left
-				lazy_delete_file(cur_f);
+				publish(group, data->path, new_name);
+			} else { // REMOVE
+				publish(group, data->path, "");
 			}
 			
-			file_ptr fp = file_ptr(new DBFS::File(cur_name));
-			get_data(node).f = fp;
-			forest::details::Tree::save_leaf(node, fp);
-		} else { // REMOVE
+			forest::details::unlock_write(node);
+		} else if(it->type == SAVE_TYPES::LEAF){
+			node_ptr node = std::static_pointer_cast<tree_t::Node>(it->node);
+			
+			// To avoid any deadlocks and RC, lock the node
+			change_lock_write(node);
+			
+			it = lock_item(item);
+			
+			node_data_ptr data = get_node_data(node);
 			file_ptr cur_f = get_data(node).f;
-			if(cur_f){
-				opened_files_inc();
+			
+			if(it->action == ACTION_TYPE::SAVE){
+				// New version is written aside and replaces the current one
+				// when it is complete
+				file_ptr fp = file_ptr(DBFS::create());
+				get_data(node).f = fp;
+				forest::details::Tree::save_leaf(node, fp);
+				{
+					auto flock = fp->get_lock();
+					fp->stream().seekp(0, std::ios::end);
+					io.set_bytes(fp->tellp());
+				}
 				
-				// Same as for saving
-				lazy_delete_file(cur_f);
+				publish(group, data->path, "", cur_f, fp);
+			} else { // REMOVE
+				get_data(node).f = nullptr;
+				publish(group, data->path, "", cur_f);
+				
+				value_log->release(get_data(node).log_refs);
+				get_data(node).log_refs.clear();
 			}
-			get_data(node).f = nullptr;
-		}
-		
-		change_unlock_write(node);
-	} else {
-		tree_ptr tree = std::static_pointer_cast<Tree>(it->node);
-		
-		// To avoid any deadlocks and RC, lock the node
-		tree->get_tree()->lock_write();
-		
-		it = lock_item(item);
-		
-		if(it->action == ACTION_TYPE::SAVE){
-			DBFS::File* base_f = DBFS::create();
-			forest::details::Tree::save_base(tree, base_f);
 			
-			string base_file_name = tree->get_name();
-			string new_base_file_name = base_f->name();
+			change_unlock_write(node);
+		} else {
+			tree_ptr tree = std::static_pointer_cast<Tree>(it->node);
+			
+			// To avoid any deadlocks and RC, lock the node
+			tree->get_tree()->lock_write();
+			
+			it = lock_item(item);
 			
-			delete base_f;
-			DBFS::remove(base_file_name);
-			DBFS::move(new_base_file_name, base_file_name);
-		} else { // REMOVE
-			remove_file_async(item);
+			if(it->action == ACTION_TYPE::SAVE){
+				// Changes made from now on will queue the base again
+				tree->base_dirty = false;
+				
+				DBFS::File* base_f = DBFS::create();
+				io.set_bytes(forest::details::Tree::save_base(tree, base_f));
+				
+				string new_base_file_name = base_f->name();
+				delete base_f;
+				
+				publish(group, tree->get_name(), new_base_file_name);
+			} else { // REMOVE
+				publish(group, item, "");
+			}
+			tree->get_tree()->unlock_write();
 		}
-		tree->get_tree()->unlock_write();
 	}
 	
-	
 	lock.lock();
 	
 	// Remove item
@@ -278,10 +389,129 @@ void forest::details::Savior::save_item(save_key item)
 		}
 	}
 	
+	pull_linked(item, group);
+	
 	// Notify for changes
 	cv.notify_all();
 }
 
+void forest::details::Savior::run_group(save_group& group, size_t threads_count)
+{
+	group.id = journal->begin();
+	size_t initial = group.items.size();
+	size_t next = 0;
+	
+	auto worker = [this, &group, &next, initial]{
+		while(true){
+			std::unique_lock<std::mutex> lock(group.mtx);
+			if(next >= group.items.size()){
+				return;
+			}
+			size_t i = next++;
+			save_key item = group.items[i];
+			lock.unlock();
+			
+			save_item(item, group, i >= initial);
+		}
+	};
+	
+	thread_pool->parallel(Thread_pool::PRIORITY::SAVE, threads_count, worker);
+	
+	// Previous versions are not needed once the whole group is on disk
+	journal->commit(group.id, std::move(group.on_commit));
+}
+
+void forest::details::Savior::publish(save_group& group, const string& target, string temp, file_ptr cur_f, file_ptr new_f)
+{
+	if(new_f){
+		temp = new_f->name();
+	}
+	
+	string backup;
+	if(cur_f || DBFS::exists(target)){
+		backup = DBFS::random_filename();
+	} else if(!temp.size()){
+		// Nothing to remove
+		return;
+	}
+	
+	// Record goes first, so a crash at any point could be rolled back
+	journal->record(group.id, target, backup, temp);
+	
+	if(cur_f){
+		auto locked = cur_f->get_lock();
+		cur_f->move(backup);
+	} else if(backup.size()){
+		DBFS::move(target, backup);
+	}
+	
+	if(new_f){
+		auto locked = new_f->get_lock();
+		new_f->move(target);
+	} else if(temp.size()){
+		DBFS::move(temp, target);
+	}
+	
+	if(!backup.size()){
+		return;
+	}
+	
+	std::lock_guard<std::mutex> lock(group.mtx);
+	group.on_commit.push_back([this, cur_f, backup]{
+		if(cur_f){
+			// Update count of opened files to not exceed the limit
+			forest::details::opened_files_inc();
+			
+			// Other could still reference this leaf, so delete file
+			// when no references left
+			lazy_delete_file(cur_f);
+		} else {
+			remove_file_async(backup);
+		}
+	});
+}
+
+void forest::details::Savior::pull_linked(save_key& item, save_group& group)
+{
+	auto it = links.find(item);
+	if(it == links.end()){
+		return;
+	}
+	
+	// Nodes changed by the same split or join are saved in the same group
+	std::lock_guard<std::mutex> lock(group.mtx);
+	for(auto& related : it->second){
+		if(map.count(related) && !group.members.count(related)){
+			group.members.insert(related);
+			group.items.push_back(related);
+		}
+		
+		auto rel = links.find(related);
+		if(rel != links.end()){
+			rel->second.erase(item);
+			if(rel->second.empty()){
+				links.erase(rel);
+			}
+		}
+	}
+	links.erase(item);
+}
+
+void forest::details::Savior::link(save_key item, const std::vector<save_key>& related, bool dirty_only)
+{
+	auto lock = map_mtx.hold();
+	for(auto& r : related){
+		if(r == item || r == LEAF_NULL){
+			continue;
+		}
+		if(dirty_only && !map.count(r) && !links.count(r)){
+			continue;
+		}
+		links[item].insert(r);
+		links[r].insert(item);
+	}
+}
+
 void forest::details::Savior::run_scheduler()
 {
 	if(scheduler_running){
@@ -307,17 +537,93 @@ void forest::details::Savior::delayed_save()
 			return;
 		}
 		///{
-		save_key item = items_queue.back().first;
-		items_queue.pop();
+		std::vector<save_key> items = pick_flush_items(flush_round_size());
+		++rounds;
+		round_items += items.size();
 		///}
-		save(item, false);
 		unlock_map();
+		
+		save_bunch(items);
+	}
+}
+
+forest::details::uint_t forest::details::Savior::flush_round_size()
+{
+	uint_t depth = items_queue.size();
+	uint_t limit = std::max(SAVIOUR_QUEUE_LENGTH, 1);
+	
+	// Pressure grows with the square of the queue depth, so a light load
+	// keeps coalescing writes while a filling queue is drained aggressively
+	uint_t count = (depth * depth + limit - 1) / limit;
+	
+	// Do not take more than could be saved during one schedule period
+	if(save_mks > 0){
+		uint_t threads = thread_pool->size();
+		count = std::min(count, (uint_t)(SCHEDULE_TIMER * threads / save_mks) + 1);
+	}
+	
+	count = std::min(count, (uint_t)std::max(SAVIOUR_FLUSH_LIMIT, 1));
+	return std::max(count, (uint_t)1);
+}
+
+std::vector<forest::details::Savior::save_key> forest::details::Savior::pick_flush_items(uint_t count)
+{
+	using item_score = std::pair<double, save_key>;
+	
+	auto now = std::chrono::steady_clock::now();
+	std::vector<item_score> scores;
+	scores.reserve(items_queue.size());
+	
+	// Prefer items that are dirty for the longest time or written the most
+	for(auto it = items_queue.begin(); it != items_queue.end(); ++it){
+		double age = std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.since).count();
+		scores.push_back(std::make_pair((age + 1) * it->second.writes, it->first));
+	}
+	
+	count = std::min(count, (uint_t)scores.size());
+	std::partial_sort(scores.begin(), scores.begin() + count, scores.end(), [](const item_score& a, const item_score& b){
+		return a.first > b.first;
+	});
+	
+	std::vector<save_key> items;
+	items.reserve(count);
+	for(uint_t i=0;i<count;i++){
+		items.push_back(scores[i].second);
+		items_queue.remove(scores[i].second);
+	}
+	return items;
+}
+
+void forest::details::Savior::save_bunch(std::vector<save_key>& items)
+{
+	auto start = std::chrono::steady_clock::now();
+	
+	// Whole round is published as one group
+	save_group group;
+	for(auto& item : items){
+		if(group.members.insert(item).second){
+			group.items.push_back(item);
+		}
+	}
+	
+	size_t threads_count = std::min(items.size(), (size_t)thread_pool->size());
+	run_group(group, threads_count);
+	
+	// Observed time of saving a single item
+	if(group.items.size()){
+		uint_t spent = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		double sample = (double)spent * threads_count / group.items.size();
+		save_mks = save_mks > 0 ? save_mks * 0.8 + sample * 0.2 : sample;
 	}
 }
 
 void forest::details::Savior::schedule_save(save_key& item)
 {
-	items_queue.push(item, true);
+	if(items_queue.has(item)){
+		++items_queue.get(item).writes;
+	} else {
+		items_queue.push(item, flush_stat{std::chrono::steady_clock::now(), 1});
+	}
 	run_scheduler();
 }
 
@@ -326,6 +632,7 @@ forest::details::Savior::save_value* forest::details::Savior::define_item(save_k
 	
 	save_value* val = new save_value();
 	map[item].push(val);
+	pending_items = map.size();
 	
 	val->action = action;
 	val->type = type;
@@ -353,7 +660,7 @@ forest::details::Savior::save_value* forest::details::Savior::get_item(save_key&
 
 forest::details::Savior::save_value* forest::details::Savior::lock_item(save_key& item)
 {
-	std::lock_guard<std::mutex> lock(map_mtx);
+	auto lock = map_mtx.hold();
 	locking_items.insert(item);
 	return get_item(item);
 }
@@ -364,7 +671,14 @@ void forest::details::Savior::pop_item(save_key& item)
 	delete map_ref.front();
 	map_ref.pop();
 	if(map_ref.empty()){
+		// Saved node takes away the bytes written into it
+		auto it = item_bytes.find(item);
+		if(it != item_bytes.end()){
+			dirty_bytes -= std::min((uint_t)dirty_bytes, it->second);
+			item_bytes.erase(it);
+		}
 		map.erase(item);
+		pending_items = map.size();
 	}
 }
 
@@ -379,15 +693,8 @@ void forest::details::Savior::lazy_delete_file(file_ptr f)
 
 void forest::details::Savior::wait_for_threads()
 {
-	while(true){
-		join_mtx.lock();
-		if(thrds.empty()){
-			join_mtx.unlock();
-			return;
-		}
-		auto t = std::move(thrds.front());
-		thrds.pop();
-		join_mtx.unlock();
-		t.join();
+	std::unique_lock<std::mutex> lock(join_mtx);
+	while(async_saves){
+		join_cv.wait(lock);
 	}
 }
@@ -3,12 +3,16 @@
 
 #include <queue>
 #include <thread>
+#include <chrono>
+#include <vector>
 #include "dbutils.hpp"
 #include "node_data.hpp"
 #include "lock.hpp"
 #include "cache.hpp"
 #include "tree.hpp"
 #include "listcache.hpp"
+#include "journal.hpp"
+#include "lock_profiler.hpp"
 
 #ifdef DEBUG_PERF
 extern unsigned long int h_blocking;
@@ -23,6 +27,12 @@ namespace details{
 	
 	extern int SCHEDULE_TIMER;
 	extern int SAVIOUR_QUEUE_LENGTH;
+	extern int SAVIOUR_FLUSH_LIMIT;
+	extern int SAVE_HIGH_ITEMS;
+	extern int SAVE_LOW_ITEMS;
+	extern int SAVE_HIGH_BYTES;
+	extern int SAVE_LOW_BYTES;
+	extern bool SAVE_REJECT_STALLED;
 	
 	class Savior{
 		
@@ -35,25 +45,65 @@ namespace details{
 			bool using_now = false;
 		};
 		
+		struct flush_stat{
+			std::chrono::steady_clock::time_point since;
+			uint_t writes;
+		};
+		
+		// Items published within one journal group
+		struct save_group{
+			Journal::group_t id;
+			std::vector<string> items;
+			std::unordered_set<string> members;
+			std::vector<std::function<void()>> on_commit;
+			std::mutex mtx;
+		};
+		
 		public:
 			using save_key = string;
 			using callback_t = std::function<void(void_shared, SAVE_TYPES)>;
 			
+			struct stall_stats_t{
+				uint_t stalls = 0;
+				uint_t stall_mks = 0;
+				uint_t rejected = 0;
+				uint_t dirty_bytes = 0;
+				uint_t pending = 0;
+			};
+			
+			struct flush_stats_t{
+				uint_t rounds = 0;
+				uint_t items = 0;
+			};
+			
 			Savior();
 			virtual ~Savior();
 			void put(save_key item, SAVE_TYPES type, void_shared node);
 			void remove(save_key item, SAVE_TYPES type, void_shared node);
 			void leave(save_key item, SAVE_TYPES type, void_shared node);
 			void save(save_key item, bool async = false);
+			void flush();
 			void get(save_key item);
 			int save_queue_size();
+			uint_t queued_writes(save_key item);
 			void remove_file_async(string name);
+			void link(save_key item, const std::vector<save_key>& related, bool dirty_only = false);
+			void throttle(uint_t bytes);
+			stall_stats_t stall_stats();
+			flush_stats_t flush_stats();
 			
 		private:
 			void save_item(save_key item);
+			void save_item(save_key item, save_group& group, bool pulled);
+			void run_group(save_group& group, size_t threads_count);
+			void publish(save_group& group, const string& target, string temp, file_ptr cur_f = nullptr, file_ptr new_f = nullptr);
+			void pull_linked(save_key& item, save_group& group);
 			save_value* define_item(save_key item, SAVE_TYPES type, ACTION_TYPE action, void_shared node);
 			void run_scheduler();
 			void delayed_save();
+			uint_t flush_round_size();
+			std::vector<save_key> pick_flush_items(uint_t count);
+			void save_bunch(std::vector<save_key>& items);
 			void schedule_save(save_key& item);
 			save_value* get_item(save_key& item);
 			save_value* lock_item(save_key& item);
@@ -65,28 +115,44 @@ namespace details{
 			void unlock_map();
 			void wait_for_threads();
 			void save_all();
+			double overage();
 			
-			Thread_worker scheduler_worker;
-			Thread_worker joiner;
-			Thread_worker file_deleter;
+			Thread_worker scheduler_worker{Thread_pool::PRIORITY::SAVE, true};
+			Thread_worker file_deleter{Thread_pool::PRIORITY::DELETE};
 			
 			callback_t callback;
 		
-			std::mutex map_mtx, join_mtx;
-			std::condition_variable cv;
+			profiled_mutex map_mtx{LOCK_CLASS::SAVIOR_MAP};
+			std::mutex join_mtx;
+			std::condition_variable_any cv;
+			std::condition_variable join_cv;
 			
 			uint_t time;
 			uint_t cluster_limit;
 			uint_t cluster_reduce_length;
 			std::unordered_map<save_key, std::queue<save_value*>> map;
-			std::unordered_set<save_key> saving_items, locking_items;
+			std::unordered_map<save_key, Journal::group_t> saving_items;
+			std::unordered_set<save_key> locking_items;
+			std::unordered_map<save_key, std::unordered_set<save_key>> links;
+			std::unordered_map<save_key, uint_t> item_bytes;
 			bool saving = false;
 			bool resolving = false;
 			
-			ListCache<save_key, bool> items_queue;
+			ListCache<save_key, flush_stat> items_queue;
 			bool scheduler_running = false;
+			double save_mks = 0;
+			
+			int async_saves = 0;
 			
-			std::queue<std::thread> thrds;
+			std::atomic<uint_t> pending_items = 0;
+			std::atomic<uint_t> dirty_bytes = 0;
+			std::atomic<uint_t> stalls = 0;
+			std::atomic<uint_t> stall_mks = 0;
+			std::atomic<uint_t> rejected = 0;
+			std::atomic<bool> stalling = false;
+			std::atomic<uint_t> rounds = 0;
+			std::atomic<uint_t> round_items = 0;
+			static thread_local uint_t unqueued;
 	};
 	
 } // details
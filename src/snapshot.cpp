@@ -0,0 +1,91 @@
+#include "snapshot.hpp"
+
+forest::details::Snapshot::Snapshot(tree_ptr tree) : tree(tree)
+{
+	cache::tree_cache_m.lock();
+	tree->tree_reserve();
+	cache::tree_cache_m.unlock();
+	
+	epoch = tree->snapshots.open();
+}
+
+forest::details::Snapshot::~Snapshot()
+{
+	tree->snapshots.close(epoch);
+	
+	cache::tree_cache_m.lock();
+	tree->tree_release();
+	cache::tree_cache_m.unlock();
+}
+
+forest::details::detached_leaf_ptr forest::details::Snapshot::find(tree_t::key_type key)
+{
+	// Tree goes first, a change made meanwhile is already kept by then
+	tree_t::val_type val = nullptr;
+	{
+		auto it = tree->get_tree()->find(key);
+		if(it != tree->get_tree()->end()){
+			val = it->second;
+		}
+	}
+	
+	tree_t::val_type kept;
+	if(tree->snapshots.lookup(key, epoch, kept)){
+		val = kept;
+	}
+	
+	if(!val){
+		throw TreeException(TreeException::ERRORS::LEAF_DOES_NOT_EXISTS);
+	}
+	return detached_leaf_ptr(new detached_leaf(val));
+}
+
+void forest::details::Snapshot::scan(scan_fn fn)
+{
+	scan("", nullptr, fn);
+}
+
+void forest::details::Snapshot::scan(tree_t::key_type from, tree_t::key_type to, scan_fn fn)
+{
+	scan(from, &to, fn);
+}
+
+void forest::details::Snapshot::scan(tree_t::key_type from, const tree_t::key_type* to, scan_fn& fn)
+{
+	SnapshotLog::versions_t changed;
+	tree_t::key_type last = from;
+	bool inclusive = true;
+	
+	// Items removed since the snapshot are not met in the tree,
+	// so they are taken from the versions between the visited keys
+	auto removed_before = [this, &changed, &last, &inclusive, &fn](const tree_t::key_type* key){
+		changed.clear();
+		tree->snapshots.between(last, inclusive, key, epoch, changed);
+		for(auto& item : changed){
+			if(item.second){
+				fn(item.first, detached_leaf_ptr(new detached_leaf(item.second)));
+			}
+		}
+	};
+	
+	tree_t::iterator it = tree->get_tree()->lower_bound(from);
+	while(!it.expired() && (!to || it->first < *to)){
+		tree_t::key_type key = it->first;
+		tree_t::val_type val = it->second;
+		
+		removed_before(&key);
+		
+		tree_t::val_type kept;
+		if(tree->snapshots.lookup(key, epoch, kept)){
+			val = kept;
+		}
+		if(val){
+			fn(key, detached_leaf_ptr(new detached_leaf(val)));
+		}
+		
+		last = key;
+		inclusive = false;
+		++it;
+	}
+	removed_before(to);
+}
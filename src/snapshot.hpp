@@ -0,0 +1,40 @@
+#ifndef FOREST_SNAPSHOT_H
+#define FOREST_SNAPSHOT_H
+
+#include <memory>
+#include "dbutils.hpp"
+#include "detached_leaf.hpp"
+#include "cache.hpp"
+#include "tree.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Read view of the tree at the moment of its creation.
+	// Current items are read from the tree itself, items changed since
+	// then are taken from the versions kept by the tree.
+	class Snapshot{
+		
+		public:
+			using scan_fn = std::function<void(const tree_t::key_type&, detached_leaf_ptr)>;
+			
+			Snapshot(tree_ptr tree);
+			virtual ~Snapshot();
+			
+			detached_leaf_ptr find(tree_t::key_type key);
+			void scan(scan_fn fn);
+			void scan(tree_t::key_type from, tree_t::key_type to, scan_fn fn);
+		
+		private:
+			void scan(tree_t::key_type from, const tree_t::key_type* to, scan_fn& fn);
+			
+			tree_ptr tree;
+			uint_t epoch;
+	};
+	
+	using Snapshot_ptr = std::shared_ptr<Snapshot>;
+
+} // details
+} // forest
+
+#endif // FOREST_SNAPSHOT_H
@@ -0,0 +1,89 @@
+#include "snapshot_log.hpp"
+
+
+forest::details::uint_t forest::details::SnapshotLog::open()
+{
+	// Writes already started without keeping versions are finished first
+	std::unique_lock<std::shared_mutex> g(gate);
+	std::lock_guard<mutex> lock(mtx);
+	
+	epochs.insert(clock);
+	opened = true;
+	return clock;
+}
+
+void forest::details::SnapshotLog::close(uint_t epoch)
+{
+	std::lock_guard<mutex> lock(mtx);
+	epochs.erase(epochs.find(epoch));
+	
+	if(epochs.empty()){
+		opened = false;
+		versions.clear();
+		return;
+	}
+	
+	// Versions made before the oldest snapshot are not seen by anyone
+	uint_t oldest = *epochs.begin();
+	for(auto it = versions.begin(); it != versions.end();){
+		auto& vec = it->second;
+		size_t c = 0;
+		while(c < vec.size() && vec[c].epoch <= oldest){
+			c++;
+		}
+		vec.erase(vec.begin(), vec.begin() + c);
+		if(vec.empty()){
+			it = versions.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void forest::details::SnapshotLog::remember(const tree_t::key_type& key, tree_t::val_type prev)
+{
+	std::lock_guard<mutex> lock(mtx);
+	if(epochs.empty()){
+		return;
+	}
+	
+	// Every open snapshot already sees a version saved after the newest
+	// of them, so only the first change since then is kept
+	auto& vec = versions[key];
+	if(vec.size() && vec.back().epoch > *epochs.rbegin()){
+		return;
+	}
+	vec.push_back(version_t{++clock, std::move(prev)});
+}
+
+bool forest::details::SnapshotLog::lookup(const tree_t::key_type& key, uint_t epoch, tree_t::val_type& val)
+{
+	std::lock_guard<mutex> lock(mtx);
+	auto it = versions.find(key);
+	if(it == versions.end()){
+		return false;
+	}
+	
+	// The first change after the snapshot keeps the value it saw
+	for(auto& v : it->second){
+		if(v.epoch > epoch){
+			val = v.val;
+			return true;
+		}
+	}
+	return false;
+}
+
+void forest::details::SnapshotLog::between(const tree_t::key_type& from, bool inclusive, const tree_t::key_type* to, uint_t epoch, versions_t& out)
+{
+	std::lock_guard<mutex> lock(mtx);
+	auto it = inclusive ? versions.lower_bound(from) : versions.upper_bound(from);
+	for(; it != versions.end() && (!to || it->first < *to); ++it){
+		for(auto& v : it->second){
+			if(v.epoch > epoch){
+				out.push_back(std::make_pair(it->first, v.val));
+				break;
+			}
+		}
+	}
+}
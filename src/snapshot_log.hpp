@@ -0,0 +1,66 @@
+#ifndef FOREST_SNAPSHOT_LOG_H
+#define FOREST_SNAPSHOT_LOG_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include <shared_mutex>
+#include "dbutils.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Previous versions of items changed while snapshots of the tree exist.
+	// Values are shared, so a kept version stays readable until the last
+	// snapshot that could see it is closed. Writers never wait for readers.
+	class SnapshotLog{
+		
+		static const int KEY_STRIPES = 64;
+		
+		struct version_t{
+			uint_t epoch;
+			tree_t::val_type val;
+		};
+		
+		public:
+			using versions_t = std::vector<std::pair<tree_t::key_type, tree_t::val_type>>;
+			
+			uint_t open();
+			void close(uint_t epoch);
+			bool active();
+			std::shared_lock<std::shared_mutex> write_lock();
+			mutex& key_mutex(const tree_t::key_type& key);
+			void remember(const tree_t::key_type& key, tree_t::val_type prev);
+			bool lookup(const tree_t::key_type& key, uint_t epoch, tree_t::val_type& val);
+			void between(const tree_t::key_type& from, bool inclusive, const tree_t::key_type* to, uint_t epoch, versions_t& out);
+		
+		private:
+			std::map<tree_t::key_type, std::vector<version_t>> versions;
+			std::multiset<uint_t> epochs;
+			uint_t clock = 0;
+			std::atomic<bool> opened = false;
+			mutex mtx;
+			std::shared_mutex gate;
+			mutex stripes[KEY_STRIPES];
+	};
+
+} // details
+} // forest
+
+
+inline bool forest::details::SnapshotLog::active()
+{
+	return opened.load();
+}
+
+inline std::shared_lock<std::shared_mutex> forest::details::SnapshotLog::write_lock()
+{
+	return std::shared_lock<std::shared_mutex>(gate);
+}
+
+inline forest::details::mutex& forest::details::SnapshotLog::key_mutex(const tree_t::key_type& key)
+{
+	return stripes[std::hash<tree_t::key_type>()(key) % KEY_STRIPES];
+}
+
+#endif // FOREST_SNAPSHOT_LOG_H
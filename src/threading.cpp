@@ -21,43 +21,178 @@ void forest::Thread_wait::wait(){
 }
 
 
-// Thread_worker
-forest::Thread_worker::Thread_worker(){
-	t = std::thread([this]{
-		while(true){
-			work_fn fn;
+// Thread_pool
+forest::Thread_pool::Thread_pool(int threads){
+	started = std::chrono::steady_clock::now();
+	for(int i=0;i<threads;i++){
+		workers.push_back(std::unique_ptr<worker_t>(new worker_t()));
+	}
+	for(int i=0;i<threads;i++){
+		this->threads.push_back(std::thread([this, i]{ run(i); }));
+	}
+}
+
+forest::Thread_pool::~Thread_pool(){
+	{
+		std::unique_lock<std::mutex> lock(m);
+		active = false;
+		cv.notify_all();
+	}
+	for(auto& t : threads){
+		t.join();
+	}
+}
+
+void forest::Thread_pool::submit(PRIORITY priority, task_fn f){
+	// Worker keeps its own tasks, others are spread between workers
+	size_t index = current == this ? current_index : next++ % workers.size();
+	
+	// Counted before it can be taken, so the count never goes below zero
+	++queued;
+	{
+		std::lock_guard<std::mutex> lock(workers[index]->m);
+		workers[index]->q[(int)priority].push_back(std::move(f));
+	}
+
+	std::lock_guard<std::mutex> lock(m);
+	cv.notify_one();
+}
+
+void forest::Thread_pool::parallel(PRIORITY priority, size_t count, const task_fn& f){
+	struct state_t{
+		std::mutex m;
+		std::condition_variable cv;
+		int running = 0;
+		bool closed = false;
+	};
+	auto state = std::make_shared<state_t>();
+
+	// Caller works too, helpers started after it finished have nothing to do
+	for(size_t i=1;i<count;i++){
+		submit(priority, [state, &f]{
 			{
-				auto lock = get_lock();
-				while(q.empty()){
-					busy = false;
-					notify();
-					if(!active) return;
-					cv.wait(lock);
+				std::lock_guard<std::mutex> lock(state->m);
+				if(state->closed){
+					return;
 				}
-				busy = true;
-				fn = q.front();
-				q.pop();
+				++state->running;
+			}
+			f();
+			std::lock_guard<std::mutex> lock(state->m);
+			if(--state->running == 0){
+				state->cv.notify_all();
+			}
+		});
+	}
+	f();
+
+	std::unique_lock<std::mutex> lock(state->m);
+	state->closed = true;
+	while(state->running){
+		state->cv.wait(lock);
+	}
+}
+
+int forest::Thread_pool::size(){
+	return workers.size();
+}
+
+int forest::Thread_pool::queue_size(){
+	return queued;
+}
+
+double forest::Thread_pool::utilization(){
+	long long spent = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+	if(spent <= 0){
+		return 0;
+	}
+	return std::min(1.0, (double)busy_mks / ((double)spent * workers.size()));
+}
+
+void forest::Thread_pool::run(size_t index){
+	current = this;
+	current_index = index;
+
+	while(true){
+		task_fn f;
+		if(take(index, f)){
+			auto start = std::chrono::steady_clock::now();
+			f();
+			busy_mks += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m);
+		while(!queued){
+			if(!active){
+				return;
 			}
-			fn();
+			cv.wait(lock);
 		}
-	});
+	}
 }
 
-forest::Thread_worker::~Thread_worker(){ 
-	close(); 
-	t.join(); 
+bool forest::Thread_pool::take(size_t index, task_fn& f){
+	size_t count = workers.size();
+	for(int p=0;p<PRIORITIES;p++){
+		// Own tasks are taken from the end, while they are still hot
+		{
+			worker_t& own = *workers[index];
+			std::lock_guard<std::mutex> lock(own.m);
+			if(own.q[p].size()){
+				f = std::move(own.q[p].back());
+				own.q[p].pop_back();
+				--queued;
+				return true;
+			}
+		}
+		for(size_t i=1;i<count;i++){
+			worker_t& other = *workers[(index + i) % count];
+			std::lock_guard<std::mutex> lock(other.m);
+			if(other.q[p].size()){
+				f = std::move(other.q[p].front());
+				other.q[p].pop_front();
+				--queued;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+// Thread_worker
+forest::Thread_worker::Thread_worker(Thread_pool::PRIORITY priority, bool dedicated) : priority(priority), dedicated(dedicated){
+	// ctor
+}
+
+forest::Thread_worker::~Thread_worker(){
+	close();
 }
 
 void forest::Thread_worker::close(){
-	auto lock = get_lock();
-	active = false;
-	notify(); 
+	wait();
+	if(thread.joinable()){
+		thread.join();
+	}
 }
 
 void forest::Thread_worker::work(work_fn f){
 	auto lock = get_lock();
-	q.push(f);
-	notify();
+	q.push(std::move(f));
+	if(busy){
+		return;
+	}
+	busy = true;
+	if(dedicated){
+		// Previous thread has nothing left to do once it is not busy
+		if(thread.joinable()){
+			thread.join();
+		}
+		thread = std::thread([this]{ drain(); });
+		return;
+	}
+	details::thread_pool->submit(priority, [this]{ drain(); });
 }
 
 void forest::Thread_worker::wait(){
@@ -67,14 +202,31 @@ void forest::Thread_worker::wait(){
 	}
 }
 
-bool forest::Thread_worker::is_busy(){ 
-	return busy; 
+bool forest::Thread_worker::is_busy(){
+	return busy;
+}
+
+void forest::Thread_worker::drain(){
+	while(true){
+		work_fn fn;
+		{
+			auto lock = get_lock();
+			if(q.empty()){
+				busy = false;
+				notify();
+				return;
+			}
+			fn = std::move(q.front());
+			q.pop();
+		}
+		fn();
+	}
 }
 
-void forest::Thread_worker::notify(){ 
-	cv.notify_all(); 
+void forest::Thread_worker::notify(){
+	cv.notify_all();
 }
 
-forest::Thread_worker::lock_t forest::Thread_worker::get_lock(){ 
-	return lock_t(m); 
+forest::Thread_worker::lock_t forest::Thread_worker::get_lock(){
+	return lock_t(m);
 }
@@ -5,6 +5,10 @@
 #include <memory>
 #include <condition_variable>
 #include <queue>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <functional>
 
@@ -27,18 +31,64 @@ namespace forest{
 			struct destruct_dec{
 				~destruct_dec(){ Thread_wait::dec(); }
 			};
-		
+			
 			inline static int count = 0;
 			inline static std::mutex m;
-			inline static std::condition_variable cv;	
+			inline static std::condition_variable cv;
 	};
-
+	
+	// Shared pool for all the background work.
+	// Every worker has its own deque per priority, tasks pushed by the worker
+	// are taken back from the end, idle workers steal from the beginning of
+	// the others. Higher priority tasks are taken first.
+	class Thread_pool{
+		typedef std::function<void()> task_fn;
+		
+		public:
+			enum class PRIORITY{ SAVE, DELETE, PREFETCH, COMPACTION };
+			
+			Thread_pool(int threads);
+			~Thread_pool();
+			void submit(PRIORITY priority, task_fn f);
+			void parallel(PRIORITY priority, size_t count, const task_fn& f);
+			int size();
+			int queue_size();
+			double utilization();
+		
+		private:
+			static const int PRIORITIES = 4;
+			
+			struct worker_t{
+				std::deque<task_fn> q[PRIORITIES];
+				std::mutex m;
+			};
+			
+			void run(size_t index);
+			bool take(size_t index, task_fn& f);
+			
+			std::vector<std::unique_ptr<worker_t>> workers;
+			std::vector<std::thread> threads;
+			std::atomic<size_t> next = 0;
+			std::atomic<int> queued = 0;
+			std::atomic<long long> busy_mks = 0;
+			std::chrono::steady_clock::time_point started;
+			std::mutex m;
+			std::condition_variable cv;
+			bool active = true;
+			
+			inline static thread_local Thread_pool* current = nullptr;
+			inline static thread_local size_t current_index = 0;
+	};
+	
+	// Runs its tasks one by one in the order they came, on the pool.
+	// Long running loops get a thread of their own instead, so they
+	// never hold a pool worker away from the short tasks
 	class Thread_worker{
 		typedef std::function<void()> work_fn;
 		typedef std::unique_lock<std::mutex> lock_t;
 		
 		public:
-			Thread_worker();
+			Thread_worker(Thread_pool::PRIORITY priority = Thread_pool::PRIORITY::SAVE, bool dedicated = false);
 			~Thread_worker();
 			void close();
 			void work(work_fn f);
@@ -46,16 +96,22 @@ namespace forest{
 			bool is_busy();
 		
 		private:
+			void drain();
 			void notify();
 			lock_t get_lock();
 			
+			Thread_pool::PRIORITY priority;
+			bool dedicated;
+			std::thread thread;
 			std::queue<work_fn> q;
 			std::condition_variable cv;
 			std::mutex m;
-			bool active = true;
 			bool busy = false;
-			std::thread t;
 	};
+	
+	namespace details{
+		extern Thread_pool* thread_pool;
+	}
 }
 
 #endif // FOREST_THREADING_H
@@ -0,0 +1,140 @@
+#include "transaction.hpp"
+
+forest::details::Transaction::Transaction()
+{
+	// ctor
+}
+
+forest::details::Transaction::~Transaction()
+{
+	// Not committed writes are just dropped
+}
+
+forest::details::detached_leaf_ptr forest::details::Transaction::find(tree_owner_ptr tree, tree_t::key_type key)
+{
+	tree_ptr t = hold(tree);
+	item_key item(t.get(), key);
+	tree_t::val_type val;
+	
+	// Transaction sees its own writes and keeps seeing what it read once
+	auto w = writes.find(item);
+	auto r = reads.find(item);
+	if(w != writes.end()){
+		val = w->second.val;
+	} else if(r != reads.end()){
+		val = r->second.val;
+	} else {
+		val = t->current(key);
+		reads[item] = item_t{t, val};
+	}
+	
+	if(!val){
+		throw TreeException(TreeException::ERRORS::LEAF_DOES_NOT_EXISTS);
+	}
+	return detached_leaf_ptr(new detached_leaf(val));
+}
+
+void forest::details::Transaction::insert(tree_owner_ptr tree, tree_t::key_type key, detached_leaf_ptr val)
+{
+	write(tree, key, extract_leaf_val(val));
+}
+
+void forest::details::Transaction::update(tree_owner_ptr tree, tree_t::key_type key, detached_leaf_ptr val)
+{
+	write(tree, key, extract_leaf_val(val));
+}
+
+void forest::details::Transaction::remove(tree_owner_ptr tree, tree_t::key_type key)
+{
+	write(tree, key, nullptr);
+}
+
+bool forest::details::Transaction::commit()
+{
+	if(finished){
+		throw TreeException(TreeException::ERRORS::BAD_INPUT_PARAMETER);
+	}
+	if(!blossomed){
+		throw TreeException(TreeException::ERRORS::FOREST_FOLDED);
+	}
+	finished = true;
+	
+	// Backlog of saves is checked before any key is locked
+	uint_t bytes = 0;
+	for(auto& it : writes){
+		bytes += it.second.val ? it.second.val->size() : 0;
+	}
+	savior->throttle(bytes);
+	
+	// Gates go before keys, the same as for a single change of the tree
+	std::vector<std::shared_lock<std::shared_mutex>> gates;
+	for(auto& it : trees){
+		gates.push_back(it.first->snapshots.write_lock());
+	}
+	
+	// Every transaction locks keys in the order of their mutexes,
+	// so transactions touching different keys never wait for each other
+	std::vector<mutex*> mutexes;
+	for(auto* items : {&reads, &writes}){
+		for(auto& it : *items){
+			mutexes.push_back(&it.first.first->snapshots.key_mutex(it.first.second));
+		}
+	}
+	std::sort(mutexes.begin(), mutexes.end());
+	mutexes.erase(std::unique(mutexes.begin(), mutexes.end()), mutexes.end());
+	
+	std::vector<std::unique_lock<mutex>> locks;
+	for(auto* m : mutexes){
+		locks.push_back(std::unique_lock<mutex>(*m));
+	}
+	
+	if(!validate()){
+		return false;
+	}
+	apply();
+	return true;
+}
+
+forest::details::tree_ptr forest::details::Transaction::hold(tree_owner_ptr tree)
+{
+	if(finished){
+		throw TreeException(TreeException::ERRORS::BAD_INPUT_PARAMETER);
+	}
+	
+	// Owner keeps the tree reserved until the transaction is dropped
+	tree_ptr t = extract_native_tree(tree);
+	trees.insert(std::make_pair(t.get(), tree));
+	return t;
+}
+
+void forest::details::Transaction::write(tree_owner_ptr tree, tree_t::key_type& key, tree_t::val_type val)
+{
+	tree_ptr t = hold(tree);
+	writes[item_key(t.get(), key)] = item_t{t, std::move(val)};
+}
+
+bool forest::details::Transaction::validate()
+{
+	for(auto& it : reads){
+		if(!same_leaf_value(it.second.tree->current(it.first.second), it.second.val)){
+			return false;
+		}
+	}
+	return true;
+}
+
+void forest::details::Transaction::apply()
+{
+	// Record goes first, so the changes are replayed together after a crash
+	std::vector<TransactionLog::write_t> record;
+	for(auto& it : writes){
+		tree_ptr& t = it.second.tree;
+		record.push_back(TransactionLog::write_t{t->get_name(), it.first.second, it.second.val});
+	}
+	uint_t lsn = transaction_log->write(record);
+	
+	for(auto& it : writes){
+		it.second.tree->apply(it.first.second, it.second.val);
+	}
+	transaction_log->applied(lsn);
+}
@@ -0,0 +1,56 @@
+#ifndef FOREST_TRANSACTION_H
+#define FOREST_TRANSACTION_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include "dbutils.hpp"
+#include "variables.hpp"
+#include "detached_leaf.hpp"
+#include "tree_owner.hpp"
+#include "tree.hpp"
+#include "transaction_log.hpp"
+
+namespace forest{
+namespace details{
+
+	// Optimistic transaction over one or more trees.
+	// Writes are buffered and reads remember the value they saw. Commit
+	// locks only the keys it touched, checks that nothing it read was
+	// changed meanwhile, writes one log record and applies the writes.
+	class Transaction{
+		
+		using item_key = std::pair<Tree*, tree_t::key_type>;
+		
+		struct item_t{
+			tree_ptr tree;
+			tree_t::val_type val;
+		};
+		
+		public:
+			Transaction();
+			virtual ~Transaction();
+			
+			detached_leaf_ptr find(tree_owner_ptr tree, tree_t::key_type key);
+			void insert(tree_owner_ptr tree, tree_t::key_type key, detached_leaf_ptr val);
+			void update(tree_owner_ptr tree, tree_t::key_type key, detached_leaf_ptr val);
+			void remove(tree_owner_ptr tree, tree_t::key_type key);
+			bool commit();
+		
+		private:
+			tree_ptr hold(tree_owner_ptr tree);
+			void write(tree_owner_ptr tree, tree_t::key_type& key, tree_t::val_type val);
+			bool validate();
+			void apply();
+			
+			std::map<Tree*, tree_owner_ptr> trees;
+			std::map<item_key, item_t> reads, writes;
+			bool finished = false;
+	};
+	
+	using Transaction_ptr = std::shared_ptr<Transaction>;
+
+} // details
+} // forest
+
+#endif // FOREST_TRANSACTION_H
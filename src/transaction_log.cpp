@@ -0,0 +1,385 @@
+#include "transaction_log.hpp"
+#include "forest.hpp"
+
+
+forest::details::TransactionLog::TransactionLog()
+{
+	// Checkpoint replaces the log with its tail written aside
+	string next = TRANSACTION_LOG_FILE + "_next";
+	if(DBFS::exists(next)){
+		if(DBFS::exists(TRANSACTION_LOG_FILE)){
+			DBFS::remove(next);
+		} else {
+			DBFS::move(next, TRANSACTION_LOG_FILE);
+		}
+	}
+	
+	if(DBFS::exists(TRANSACTION_LOG_FILE)){
+		recover();
+		return;
+	}
+	open();
+}
+
+forest::details::TransactionLog::~TransactionLog()
+{
+	// Every change is saved by the Savior before folding
+	checkpointer.wait();
+	file = nullptr;
+	DBFS::remove(TRANSACTION_LOG_FILE);
+}
+
+forest::details::uint_t forest::details::TransactionLog::write(const std::vector<write_t>& writes)
+{
+	// Lengths go first, as keys and values may contain any bytes
+	string body;
+	for(auto& w : writes){
+		string val = w.val ? read_leaf_item(w.val) : "";
+		body += "W " + std::to_string(w.tree.size()) + " " + std::to_string(w.key.size()) + " "
+			+ (w.val ? "0 " : "1 ") + std::to_string(val.size()) + "\n";
+		body += w.tree + w.key + val;
+	}
+	
+	std::unique_lock<mutex> lock(mtx);
+	
+	// Records are numbered in the order they are written to the file
+	uint_t lsn = ++last_lsn;
+	string record = "T " + std::to_string(lsn) + " " + std::to_string(writes.size()) + "\n" + body + "E\n";
+	if(!batch){
+		batch = batch_ptr(new batch_t());
+	}
+	batch_ptr mine = batch;
+	mine->data += record;
+	mine->lsns.push_back(lsn);
+	appended += record.size();
+	ends[lsn] = appended;
+	unapplied.insert(lsn);
+	for(auto& w : writes){
+		string name = item_name(w.tree, w.key);
+		auto it = logged.find(name);
+		mine->undo.push_back(std::make_pair(name, it != logged.end() ? it->second : 0));
+		logged[name] = lsn;
+	}
+	tracked = logged.size();
+	
+	// The first committer writes records of everyone waiting meanwhile.
+	// Batches are written in order, so the open one is always the next
+	while(!mine->done){
+		if(flushing){
+			cv.wait(lock);
+			continue;
+		}
+		flushing = true;
+		batch_ptr current = std::move(batch);
+		batch = nullptr;
+		lock.unlock();
+		
+		bool ok = true;
+		try{
+			flush(current->data);
+		} catch(TreeException& e){
+			ok = false;
+		}
+		
+		lock.lock();
+		if(!ok){
+			rollback(*current);
+		}
+		current->ok = ok;
+		current->done = true;
+		flushing = false;
+		cv.notify_all();
+	}
+	
+	if(!mine->ok){
+		L_ERR("[TransactionLog::write]-(cannot write file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	
+	// Records are cut off in the background once the log grows big
+	if(bytes >= (uint_t)TRANSACTION_LOG_BYTES && !checkpointing){
+		checkpointing = true;
+		checkpointer.work([this]{
+			checkpoint();
+		});
+	}
+	
+	return lsn;
+}
+
+void forest::details::TransactionLog::applied(uint_t lsn)
+{
+	std::lock_guard<mutex> lock(mtx);
+	unapplied.erase(lsn);
+}
+
+void forest::details::TransactionLog::follow(const string& tree, const tree_t::key_type& key, const tree_t::val_type& val, const std::function<void()>& fn)
+{
+	// Caller holds the lock of the key, so no record of it can come meanwhile
+	bool has_record = false;
+	if(tracked.load()){
+		std::lock_guard<mutex> lock(mtx);
+		has_record = logged.count(item_name(tree, key));
+	}
+	if(!has_record){
+		fn();
+		return;
+	}
+	
+	// Otherwise the replay would bring back the value of the record
+	uint_t lsn = write({write_t{tree, key, val}});
+	try{
+		fn();
+	} catch(...){
+		applied(lsn);
+		throw;
+	}
+	applied(lsn);
+}
+
+void forest::details::TransactionLog::wait()
+{
+	checkpointer.wait();
+}
+
+void forest::details::TransactionLog::recover()
+{
+	string data;
+	{
+		DBFS::File* f = new DBFS::File(TRANSACTION_LOG_FILE);
+		std::stringstream ss;
+		ss << f->stream().rdbuf();
+		data = ss.str();
+		delete f;
+	}
+	
+	// Torn record at the end was never applied. Records are replayed
+	// in the order of their numbers, so the latest write of a key wins
+	uint_t pos = 0;
+	uint_t lsn = 0;
+	std::vector<entry_t> entries;
+	while(pos < data.size()){
+		uint_t start = pos;
+		entries.clear();
+		if(!parse(data, pos, lsn, entries) || lsn <= last_lsn){
+			data.resize(start);
+			break;
+		}
+		replay(entries);
+		last_lsn = lsn;
+		ends[lsn] = pos;
+		for(auto& entry : entries){
+			logged[item_name(entry.tree, entry.key)] = lsn;
+		}
+	}
+	tracked = logged.size();
+	
+	// Replayed changes are not saved yet, so records are kept until the checkpoint
+	if(!replace(data)){
+		L_ERR("[TransactionLog::recover]-(cannot write file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	appended = bytes;
+}
+
+bool forest::details::TransactionLog::parse(const string& data, uint_t& pos, uint_t& lsn, std::vector<entry_t>& entries)
+{
+	string line;
+	if(!read_line(data, pos, line) || line.size() < 3 || line[0] != 'T'){
+		return false;
+	}
+	uint_t count;
+	if(!(std::istringstream(line.substr(2)) >> lsn >> count)){
+		return false;
+	}
+	
+	for(uint_t i=0;i<count;i++){
+		if(!read_line(data, pos, line) || line.size() < 3 || line[0] != 'W'){
+			return false;
+		}
+		std::istringstream in(line.substr(2));
+		uint_t tree_len, key_len, val_len;
+		entry_t entry;
+		in >> tree_len >> key_len >> entry.removed >> val_len;
+		if(in.fail() || data.size() - pos < tree_len + key_len + val_len){
+			return false;
+		}
+		entry.tree = data.substr(pos, tree_len);
+		entry.key = data.substr(pos + tree_len, key_len);
+		entry.val = data.substr(pos + tree_len + key_len, val_len);
+		pos += tree_len + key_len + val_len;
+		entries.push_back(std::move(entry));
+	}
+	
+	return read_line(data, pos, line) && line == "E";
+}
+
+void forest::details::TransactionLog::replay(std::vector<entry_t>& entries)
+{
+	for(auto& entry : entries){
+		tree_ptr tree;
+		try{
+			tree = reach_tree(entry.tree);
+		} catch(TreeException& e){
+			// Tree was cut after the transaction
+			continue;
+		}
+		
+		// Saved or not, the key ends with the value of its latest record
+		tree->apply(entry.key, entry.removed ? nullptr : leaf_value(entry.val));
+		
+		leave_tree(tree);
+	}
+}
+
+void forest::details::TransactionLog::open()
+{
+	file = file_ptr(new DBFS::File(TRANSACTION_LOG_FILE));
+	bytes = 0;
+}
+
+void forest::details::TransactionLog::flush(const string& data)
+{
+	// Torn batch is overwritten by the next one
+	file->seekp(bytes);
+	file->write(data);
+	file->stream().flush();
+	
+	if(file->fail()){
+		file->stream().clear();
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	bytes += data.size();
+}
+
+void forest::details::TransactionLog::rollback(batch_t& batch)
+{
+	// Records of the batch never reached the file, so later records move
+	// back and keys are followed only for the records they still have
+	uint_t size = batch.data.size();
+	appended -= size;
+	for(auto lsn : batch.lsns){
+		ends.erase(lsn);
+		unapplied.erase(lsn);
+	}
+	for(auto it = ends.upper_bound(batch.lsns.back()); it != ends.end(); ++it){
+		it->second -= size;
+	}
+	
+	for(auto it = batch.undo.rbegin(); it != batch.undo.rend(); ++it){
+		auto lit = logged.find(it->first);
+		if(lit == logged.end() || lit->second > batch.lsns.back()){
+			continue;
+		}
+		if(it->second){
+			lit->second = it->second;
+		} else {
+			logged.erase(lit);
+		}
+	}
+	tracked = logged.size();
+}
+
+void forest::details::TransactionLog::checkpoint()
+{
+	uint_t lsn;
+	{
+		// Changes of records not applied yet may be missed by the saves
+		std::lock_guard<mutex> lock(mtx);
+		lsn = unapplied.size() ? *unapplied.begin() - 1 : last_lsn;
+	}
+	
+	if(lsn > checkpointed){
+		// Everything applied so far is on the disk once its groups commit
+		savior->flush();
+		journal->sync();
+		cut(lsn);
+	}
+	
+	std::lock_guard<mutex> lock(mtx);
+	checkpointing = false;
+}
+
+void forest::details::TransactionLog::cut(uint_t lsn)
+{
+	std::unique_lock<mutex> lock(mtx);
+	
+	// Commits wait while the file is replaced
+	while(flushing){
+		cv.wait(lock);
+	}
+	flushing = true;
+	
+	// Records of failed batches are gone, so the cut is at the last record left
+	auto end = ends.upper_bound(lsn);
+	uint_t from = end == ends.begin() ? 0 : std::prev(end)->second;
+	lock.unlock();
+	
+	string tail(bytes - from, '\0');
+	file->seekg(from);
+	file->read(&tail[0], tail.size());
+	bool ok = !file->fail() && replace(tail);
+	if(!ok){
+		// Log stays as it is, it is only longer than needed
+		L_ERR("[TransactionLog::cut]-(cannot write file)");
+	}
+	
+	lock.lock();
+	if(ok){
+		appended -= from;
+		ends.erase(ends.begin(), ends.upper_bound(lsn));
+		for(auto& it : ends){
+			it.second -= from;
+		}
+		for(auto it = logged.begin(); it != logged.end();){
+			if(it->second <= lsn){
+				it = logged.erase(it);
+			} else {
+				++it;
+			}
+		}
+		tracked = logged.size();
+		checkpointed = lsn;
+	}
+	flushing = false;
+	cv.notify_all();
+}
+
+bool forest::details::TransactionLog::replace(const string& data)
+{
+	// The log is removed only when its replacement is completely written
+	string next = TRANSACTION_LOG_FILE + "_next";
+	DBFS::File* f = new DBFS::File(next);
+	f->write(data);
+	f->stream().flush();
+	bool fail = f->fail();
+	delete f;
+	
+	if(fail){
+		DBFS::remove(next);
+		return false;
+	}
+	
+	file = nullptr;
+	DBFS::remove(TRANSACTION_LOG_FILE);
+	DBFS::move(next, TRANSACTION_LOG_FILE);
+	file = file_ptr(new DBFS::File(TRANSACTION_LOG_FILE));
+	bytes = data.size();
+	return true;
+}
+
+forest::details::string forest::details::TransactionLog::item_name(const string& tree, const tree_t::key_type& key)
+{
+	return std::to_string(tree.size()) + " " + tree + key;
+}
+
+bool forest::details::TransactionLog::read_line(const string& data, uint_t& pos, string& line)
+{
+	auto end = data.find('\n', pos);
+	if(end == string::npos){
+		return false;
+	}
+	line = data.substr(pos, end - pos);
+	pos = end + 1;
+	return true;
+}
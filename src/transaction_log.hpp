@@ -0,0 +1,92 @@
+#ifndef FOREST_TRANSACTION_LOG_H
+#define FOREST_TRANSACTION_LOG_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include <sstream>
+#include <condition_variable>
+#include "dbutils.hpp"
+#include "variables.hpp"
+
+namespace forest{
+namespace details{
+
+	// Redo log of committed transactions.
+	// Every commit is written as one record before its changes are applied,
+	// so the changes reach the disk together even if nodes of different
+	// trees are saved by the Savior at different moments. Records are
+	// numbered, and later writes of keys having records are logged too, so
+	// records found at bloom are replayed in their order. Once the log grows
+	// big, everything applied is saved and the records are cut off.
+	// Commits waiting for the file are written in one go.
+	class TransactionLog{
+		
+		struct entry_t{
+			string tree;
+			tree_t::key_type key;
+			bool removed;
+			string val;
+		};
+		
+		// Records written to the file in one go. Keys of a failed batch
+		// go back to the records they had before it
+		struct batch_t{
+			string data;
+			std::vector<uint_t> lsns;
+			std::vector<std::pair<string, uint_t>> undo;
+			bool done = false;
+			bool ok = false;
+		};
+		using batch_ptr = std::shared_ptr<batch_t>;
+		
+		public:
+			struct write_t{
+				string tree;
+				tree_t::key_type key;
+				tree_t::val_type val;
+			};
+			
+			TransactionLog();
+			virtual ~TransactionLog();
+			uint_t write(const std::vector<write_t>& writes);
+			void applied(uint_t lsn);
+			void follow(const string& tree, const tree_t::key_type& key, const tree_t::val_type& val, const std::function<void()>& fn);
+			void wait();
+		
+		private:
+			void recover();
+			bool parse(const string& data, uint_t& pos, uint_t& lsn, std::vector<entry_t>& entries);
+			void replay(std::vector<entry_t>& entries);
+			void open();
+			void flush(const string& data);
+			void rollback(batch_t& batch);
+			void checkpoint();
+			void cut(uint_t lsn);
+			bool replace(const string& data);
+			static string item_name(const string& tree, const tree_t::key_type& key);
+			static bool read_line(const string& data, uint_t& pos, string& line);
+			
+			file_ptr file;
+			uint_t bytes = 0;
+			uint_t appended = 0;
+			uint_t last_lsn = 0;
+			uint_t checkpointed = 0;
+			std::map<uint_t, uint_t> ends;
+			std::set<uint_t> unapplied;
+			std::unordered_map<string, uint_t> logged;
+			std::atomic<uint_t> tracked{0};
+			bool checkpointing = false;
+			batch_ptr batch;
+			bool flushing = false;
+			mutex mtx;
+			std::condition_variable cv;
+			Thread_worker checkpointer{Thread_pool::PRIORITY::SAVE, true};
+	};
+	
+	extern TransactionLog* transaction_log;
+
+} // details
+} // forest
+
+#endif // FOREST_TRANSACTION_LOG_H
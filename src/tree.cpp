@@ -7,13 +7,30 @@
 		h_l_shift=0, h_l_lock=0, h_l_free=0, h_l_ref=0, h_save_base=0; 
 #endif
 
+namespace forest{
+namespace details{
+	
+	// Root to leaf descent the current thread is making. Leafs entered
+	// without passing the stem (moving iterators, joins) are not counted
+	struct descent_t{
+		Tree* tree = nullptr;
+		int depth = 0;
+	};
+	thread_local descent_t descent;
+	
+} // details
+} // forest
+
 forest::details::Tree::Tree(string path)
 {	
 	name = path;
 	tree_base_read_t base = read_base(path);
 	
 	type = base.type;
+	set_compression(base.compression);
+	set_dictionaries(base.dicts);
 	annotation = base.annotation;
+	init_counters(base);
 	
 	// Init BPT
 	tree = new tree_t(base.factor, create_node(base.branch, base.branch_type), base.count, this);
@@ -25,11 +42,13 @@ forest::details::Tree::Tree()
 	// ctor
 }
 
-forest::details::Tree::Tree(string path, TREE_TYPES type, int factor, string annotation)
+forest::details::Tree::Tree(string path, TREE_TYPES type, int factor, string annotation, COMPRESSION_TYPES compression)
 {
 	name = path;
 	this->type = type;
+	set_compression(compression);
 	this->annotation = annotation;
+	counters.leafs.set(1);
 	
 	// Init BPT
 	tree = new tree_t(factor, create_node(LEAF_NULL, NODE_TYPES::LEAF), 0, this);
@@ -65,9 +84,11 @@ forest::details::tree_ptr forest::details::Tree::get(string path)
 	
 	// Check reference
 	if(cache::tree_cache_r.count(path)){
+		metrics.tree_cache_hits.add(1);
 		t = cache::tree_cache_r[path]->first;
 		return t;
 	}
+	metrics.tree_cache_misses.add(1);
 	
 	// Get from file
 	t = tree_ptr(new Tree());
@@ -86,7 +107,10 @@ forest::details::tree_ptr forest::details::Tree::get(string path)
 	
 	// Fill tree
 	t->set_type(base.type);
+	t->set_compression(base.compression);
+	t->set_dictionaries(base.dicts);
 	t->set_annotation(base.annotation);
+	t->init_counters(base);
 	
 	// Init BPT
 	t->set_tree(new tree_t(base.factor, create_node(base.branch, base.branch_type), base.count, t.get()));
@@ -105,6 +129,24 @@ forest::details::tree_t* forest::details::Tree::get_tree()
 	return this->tree;
 }
 
+forest::details::tree_stats_t forest::details::Tree::get_stats()
+{
+	tree_stats_t stats;
+	stats.count = std::max(counters.count.get(), (int_t)0);
+	stats.bytes = std::max(counters.bytes.get(), (int_t)0);
+	stats.leafs = std::max(counters.leafs.get(), (int_t)0);
+	stats.depth = counters.depth.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void forest::details::Tree::init_counters(tree_base_read_t& base)
+{
+	counters.count.set(base.count);
+	counters.bytes.set(base.bytes);
+	counters.leafs.set(base.leafs);
+	counters.depth.store(base.depth);
+}
+
 void forest::details::Tree::set_tree(tree_t* tree)
 {
 	this->tree = tree;
@@ -112,18 +154,74 @@ void forest::details::Tree::set_tree(tree_t* tree)
 
 void forest::details::Tree::insert(tree_t::key_type key, tree_t::val_type val, bool update)
 {
-	tree->insert(make_pair(key, std::move(val)), update);
-	tree->save_base();
+	// Writer waits here while saves are too far behind
+	savior->throttle(val ? val->size() : 0);
+	latency_timer timer(metrics.insert);
+	versioned(key, val, [this, &key, &val, update]{
+		tree->insert(make_pair(key, std::move(val)), update);
+	});
+	base_changed();
+	check_dictionary();
 }
 
 void forest::details::Tree::erase(tree_t::key_type key)
 {
-	tree->erase(key);
-	tree->save_base();
+	savior->throttle(0);
+	latency_timer timer(metrics.erase);
+	versioned(key, nullptr, [this, &key]{
+		tree->erase(key);
+	});
+	base_changed();
+}
+
+bool forest::details::Tree::cas(tree_t::key_type key, tree_t::val_type expected, tree_t::val_type val)
+{
+	savior->throttle(val ? val->size() : 0);
+	
+	// No other change of the key can get between the check and the write
+	auto gate = snapshots.write_lock();
+	auto lock = lock_key(key);
+	
+	if(!same_leaf_value(current(key), expected)){
+		return false;
+	}
+	logged_apply(key, std::move(val));
+	return true;
+}
+
+forest::details::tree_t::val_type forest::details::Tree::merge(tree_t::key_type key, const std::function<tree_t::val_type(tree_t::val_type)>& fn)
+{
+	savior->throttle(0);
+	
+	// Callback runs without locks, so it may use this tree as well.
+	// Its result is applied only if the key was not changed meanwhile
+	while(true){
+		tree_t::val_type cur = current(key);
+		tree_t::val_type val = fn(cur);
+		
+		auto gate = snapshots.write_lock();
+		auto lock = lock_key(key);
+		if(current(key) == cur){
+			logged_apply(key, val);
+			return val;
+		}
+	}
+}
+
+void forest::details::Tree::merge_delta(tree_t::key_type key, merge_operator_ptr op, string delta)
+{
+	savior->throttle(delta.size());
+	
+	auto gate = snapshots.write_lock();
+	auto lock = lock_key(key);
+	
+	// Value is merged when it is read or saved, not on every delta
+	logged_apply(key, file_data_ptr(new file_data_t(current(key), op, std::move(delta))));
 }
 
 forest::details::tree_t::iterator forest::details::Tree::find(tree_t::key_type key)
 {
+	latency_timer timer(metrics.find);
 	auto it = tree->find(key);
 	if(it == tree->end()){
 		throw TreeException(TreeException::ERRORS::LEAF_DOES_NOT_EXISTS);
@@ -131,6 +229,266 @@ forest::details::tree_t::iterator forest::details::Tree::find(tree_t::key_type k
 	return it;
 }
 
+std::vector<forest::details::tree_t::iterator> forest::details::Tree::find(std::vector<tree_t::key_type>& keys)
+{
+	std::vector<tree_t::iterator> res(keys.size());
+	std::vector<size_t> order(keys.size());
+	for(size_t i=0;i<order.size();i++){
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b){
+		return keys[a] < keys[b];
+	});
+	
+	// Small batches are found by the caller alone
+	size_t parts = std::min((size_t)thread_pool->size() + 1, keys.size() / FIND_BUNCH_MIN + 1);
+	if(parts == 1){
+		find_sorted(keys, order, 0, keys.size(), res);
+		return res;
+	}
+	
+	// Sorted keys are split into parts, each goes through its own leafs.
+	// Caller and pool helpers take the parts one by one
+	size_t part = keys.size() / parts + 1;
+	std::atomic<size_t> taken{0};
+	std::exception_ptr error;
+	mutex m;
+	thread_pool->parallel(Thread_pool::PRIORITY::PREFETCH, parts, [&]{
+		size_t i;
+		while((i = taken++) < parts){
+			try{
+				find_sorted(keys, order, std::min(part * i, keys.size()), std::min(part * (i+1), keys.size()), res);
+			} catch(...){
+				std::lock_guard<mutex> lock(m);
+				if(!error){
+					error = std::current_exception();
+				}
+			}
+		}
+	});
+	if(error){
+		std::rethrow_exception(error);
+	}
+	
+	return res;
+}
+
+forest::details::verify_report_t forest::details::Tree::verify()
+{
+	verify_report_t report;
+	mutex m;
+	
+	tree_base_read_t base;
+	try{
+		base = read_base(name);
+	} catch(TreeException& e){
+		// Base could be replaced while it was read
+		try{
+			savior->get(name);
+			base = read_base(name);
+		} catch(TreeException& e){
+			report.corrupted.push_back(name);
+			return report;
+		}
+	}
+	report.nodes++;
+	
+	// Files are checked level by level, intr nodes give the next level
+	std::vector<std::pair<string, NODE_TYPES>> level;
+	if(base.branch != LEAF_NULL){
+		level.push_back(std::make_pair(base.branch, base.branch_type));
+	}
+	
+	while(level.size()){
+		std::vector<std::pair<string, NODE_TYPES>> next_level;
+		std::atomic<size_t> next = 0;
+		
+		auto worker = [this, &level, &next_level, &next, &report, &m]{
+			size_t i;
+			while((i = next++) < level.size()){
+				string& path = level[i].first;
+				
+				// Savior may replace or remove the file while it is read, so
+				// the failed check is repeated once the save is published.
+				// File removed meanwhile belonged to a node that is gone
+				for(int attempt=0;attempt<2;attempt++){
+					try{
+						if(level[i].second == NODE_TYPES::INTR){
+							tree_intr_read_t d = read_intr(path);
+							std::lock_guard<mutex> lock(m);
+							for(auto& child : *d.child_values){
+								next_level.push_back(std::make_pair(child, d.childs_type));
+							}
+							report.nodes++;
+							delete d.child_keys;
+							delete d.child_values;
+						} else {
+							uint_t values = verify_leaf(path);
+							std::lock_guard<mutex> lock(m);
+							report.nodes++;
+							report.values += values;
+						}
+						break;
+					} catch(TreeException& e){
+						savior->get(path);
+						if(!attempt){
+							continue;
+						}
+						if(DBFS::exists(path)){
+							std::lock_guard<mutex> lock(m);
+							report.corrupted.push_back(path);
+						}
+					}
+				}
+			}
+		};
+		
+		size_t threads_count = std::min(level.size(), (size_t)thread_pool->size());
+		thread_pool->parallel(Thread_pool::PRIORITY::COMPACTION, threads_count, worker);
+		
+		level = std::move(next_level);
+	}
+	
+	return report;
+}
+
+forest::details::uint_t forest::details::Tree::verify_leaf(string path)
+{
+	tree_leaf_read_t leaf_d = read_leaf(path);
+	file_ptr f(leaf_d.file);
+	delete leaf_d.child_keys;
+	std::vector<file_data_ptr> vals = leaf_values(leaf_d, f);
+	
+	// Values are read through, so ones with checksums are verified
+	// and the truncated file fails on the missing bytes
+	int buf_size = CHUNK_SIZE;
+	char* buf = new char[buf_size];
+	try{
+		for(auto& val : vals){
+			auto reader = val->get_reader();
+			while(reader.read(buf, buf_size));
+		}
+	} catch(...){
+		delete[] buf;
+		throw;
+	}
+	delete[] buf;
+	
+	auto lock = f->get_lock();
+	if(f->fail()){
+		L_ERR("[Tree::verify_leaf]-(cannot read file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	
+	return vals.size();
+}
+
+void forest::details::Tree::versioned(const tree_t::key_type& key, const tree_t::val_type& val, const std::function<void()>& fn)
+{
+	// Snapshot opened meanwhile waits for the change to finish
+	auto gate = snapshots.write_lock();
+	
+	// Changes of the same key are kept in the order they are made,
+	// transactions hold the same lock while validating and applying
+	auto lock = lock_key(key);
+	keep_version(key);
+	logged(key, val, fn);
+}
+
+std::unique_lock<forest::details::mutex> forest::details::Tree::lock_key(const tree_t::key_type& key)
+{
+	mutex& m = snapshots.key_mutex(key);
+	timed_lock(m, metrics.lock_wait);
+	return std::unique_lock<mutex>(m, std::adopt_lock);
+}
+
+void forest::details::Tree::keep_version(const tree_t::key_type& key)
+{
+	if(!snapshots.active()){
+		return;
+	}
+	
+	tree_t::val_type prev = nullptr;
+	{
+		auto it = tree->find(key);
+		if(it != tree->end()){
+			prev = it->second;
+		}
+	}
+	snapshots.remember(key, prev);
+}
+
+forest::details::tree_t::val_type forest::details::Tree::current(const tree_t::key_type& key)
+{
+	auto it = tree->find(key);
+	if(it == tree->end()){
+		return nullptr;
+	}
+	return it->second;
+}
+
+void forest::details::Tree::apply(const tree_t::key_type& key, tree_t::val_type val)
+{
+	// Caller holds the write gate and the lock of the key
+	keep_version(key);
+	bool exists = current(key) != nullptr;
+	if(val){
+		tree->insert(make_pair(key, std::move(val)), exists);
+		check_dictionary();
+	} else if(exists){
+		tree->erase(key);
+	}
+	base_changed();
+}
+
+void forest::details::Tree::logged_apply(const tree_t::key_type& key, tree_t::val_type val)
+{
+	logged(key, val, [this, &key, &val]{
+		apply(key, val);
+	});
+}
+
+void forest::details::Tree::logged(const tree_t::key_type& key, const tree_t::val_type& val, const std::function<void()>& fn)
+{
+	// Keys changed by transactions not checkpointed yet are logged as well.
+	// The log is opened at bloom after the root tree
+	if(!transaction_log){
+		fn();
+		return;
+	}
+	transaction_log->follow(name, key, val, fn);
+}
+
+void forest::details::Tree::find_sorted(std::vector<tree_t::key_type>& keys, std::vector<size_t>& order, size_t from, size_t to, std::vector<tree_t::iterator>& res)
+{
+	tree_t::iterator it;
+	bool positioned = false;
+	
+	// Moving forward is cheaper than descending from the root
+	// while the next key is not too far from the current one
+	int walk_limit = std::max(counters.depth.load(std::memory_order_relaxed), 1) * 2;
+	
+	for(size_t i=from;i<to;i++){
+		tree_t::key_type& key = keys[order[i]];
+		
+		if(positioned && !it.expired()){
+			int steps = 0;
+			while(!it.expired() && it->first < key && steps++ < walk_limit){
+				++it;
+			}
+		}
+		if(!positioned || (!it.expired() && it->first < key)){
+			it = tree->lower_bound(key);
+			positioned = true;
+		}
+		
+		if(!it.expired() && it->first == key){
+			res[order[i]] = it;
+		} else {
+			res[order[i]] = tree->end();
+		}
+	}
+}
 
 ///////////////////////////////////////////////////////////////////////////
 
@@ -151,6 +509,10 @@ void forest::details::Tree::seed_tree(DBFS::File* f, TREE_TYPES type, int factor
 	base_d.factor = factor;
 	base_d.branch = LEAF_NULL;
 	base_d.annotation = "";
+	base_d.bytes = 0;
+	base_d.leafs = 1;
+	base_d.depth = 1;
+	base_d.compression = COMPRESSION_TYPES::NONE;
 	
 	write_base(f, base_d);
 
@@ -182,6 +544,8 @@ forest::details::tree_base_read_t forest::details::Tree::read_base(string filena
 {	
 	// Wait for file to become ready
 	savior->get(filename);
+	IOScheduler::ticket io(IOScheduler::IO_CLASS::READ);
+	latency_timer timer(metrics.node_load);
 	
 	tree_base_read_t ret;
 	DBFS::File* f = new DBFS::File(filename);
@@ -193,28 +557,72 @@ forest::details::tree_base_read_t forest::details::Tree::read_base(string filena
 	
 	ret.annotation = "";
 	f->seekg(0);
-	f->read(ret.count);
-	f->read(ret.factor);
-	f->read(t); ret.type = (TREE_TYPES)t;
-	f->read(ret.branch);
-	f->read(lt); 
+	
+	// Checksummed body follows the "#crc size" line, older files start with the body
+	std::istringstream body;
+	std::istream* in = &f->stream();
+	if(in->peek() == '#'){
+		uint_t crc, size;
+		in->get();
+		f->read(crc);
+		f->read(size);
+		in->get();
+		string data(size, '\0');
+		f->read(&data[0], size);
+		if(f->fail() || crc32c(data) != crc){
+			L_ERR("[Tree::read_base]-(checksum mismatch)");
+			delete f;
+			throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+		}
+		body.str(data);
+		in = &body;
+	}
+	
+	*in >> ret.count;
+	*in >> ret.factor;
+	*in >> t; ret.type = (TREE_TYPES)t;
+	*in >> ret.branch;
+	*in >> lt; 
 	ret.branch_type = NODE_TYPES(lt);
 	
 	// Read annotation
-	f->read(an_length);
+	*in >> an_length;
 	if(an_length > 0){
 		buf = new char[an_length+1];
-		f->read(buf, an_length+1);
+		in->read(buf, an_length+1);
 		// Skip first white space character
 		ret.annotation = string(buf+1, an_length);
 		delete[] buf;
 	}
 	
-	if(f->fail()){
+	if(in->fail()){
 		L_ERR("[Tree::read_base]-(cannot read file)");
 		delete f;
 		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
 	}
+	
+	// Statistics and compression, missing in files of older versions
+	ret.compression = COMPRESSION_TYPES::NONE;
+	*in >> ret.bytes;
+	*in >> ret.leafs;
+	*in >> ret.depth;
+	if(in->fail()){
+		ret.bytes = 0;
+		ret.leafs = 0;
+		ret.depth = 0;
+	} else {
+		int ct, dc;
+		*in >> ct;
+		if(!in->fail()){
+			ret.compression = (COMPRESSION_TYPES)ct;
+			*in >> dc;
+			for(int i=0;!in->fail() && i<dc;i++){
+				uint_t id;
+				*in >> id;
+				ret.dicts.push_back(id);
+			}
+		}
+	}
 
 	f->close();
 	delete f;
@@ -222,10 +630,55 @@ forest::details::tree_base_read_t forest::details::Tree::read_base(string filena
 	return ret;
 }
 
+std::vector<forest::details::file_data_ptr> forest::details::Tree::leaf_values(tree_leaf_read_t& leaf_d, file_ptr f)
+{
+	std::vector<uint_t>* vals_length = leaf_d.child_lengths;
+	std::vector<int_t>* segments = leaf_d.child_segments;
+	std::vector<uint_t>* offsets = leaf_d.child_offsets;
+	std::vector<uint_t>* raws = leaf_d.child_raws;
+	std::vector<int_t>* sums = leaf_d.child_sums;
+	uint_t start_data = leaf_d.start_data;
+	int c = vals_length->size();
+	uint_t last_len = 0;
+	
+	std::vector<file_data_ptr> vals(c);
+	for(int i=0;i<c;i++){
+		file_data_ptr val;
+		if(segments && (*segments)[i] >= 0){
+			// Value is stored in the value log
+			val = file_data_ptr(new file_data_t(value_log->get_segment((*segments)[i]), (*offsets)[i], (*vals_length)[i]));
+			val->set_segment((*segments)[i]);
+		} else if(raws && (*raws)[i]){
+			// Packed value, lengths keep the stored size
+			val = file_data_ptr(new file_data_t(f, start_data+last_len, (*raws)[i]));
+			val->set_packed((*vals_length)[i]);
+			last_len += (*vals_length)[i];
+		} else {
+			val = file_data_ptr(new file_data_t(f, start_data+last_len, (*vals_length)[i]));
+			last_len += (*vals_length)[i];
+		}
+		if(sums){
+			val->set_checksum((*sums)[i]);
+		}
+		vals[i] = val;
+	}
+	
+	// Clear memory
+	delete vals_length;
+	delete segments;
+	delete offsets;
+	delete raws;
+	delete sums;
+	
+	return vals;
+}
+
 forest::details::tree_intr_read_t forest::details::Tree::read_intr(string filename)
 {	
 	// Wait for file to become ready
 	savior->get(filename);
+	IOScheduler::ticket io(IOScheduler::IO_CLASS::READ);
+	latency_timer timer(metrics.node_load);
 	using key_type = tree_t::key_type;
 	
 	int t, c;
@@ -236,17 +689,33 @@ forest::details::tree_intr_read_t forest::details::Tree::read_intr(string filena
 	f->read(t);
 	f->read(c);
 	
+	// Checksummed keys and paths follow the header line as one block
+	std::istringstream block;
+	std::istream* in = &f->stream();
+	bool fail = false;
+	if(in->peek() == ' '){
+		uint_t size, crc;
+		f->read(size);
+		f->read(crc);
+		in->get();
+		string data(size, '\0');
+		f->read(&data[0], size);
+		fail = f->fail() || crc32c(crc32c(to_string(t) + " " + to_string(c)), data) != crc;
+		block.str(data);
+		in = &block;
+	}
+	
 	std::vector<key_type>* keys = new std::vector<key_type>(c-1);
 	std::vector<string>* vals = new std::vector<string>(c);
 	
-	for(int i=0;i<c-1;i++){
-		f->read((*keys)[i]);
+	for(int i=0;!fail && i<c-1;i++){
+		*in >> (*keys)[i];
 	}
-	for(int i=0;i<c;i++){
-		f->read((*vals)[i]);
+	for(int i=0;!fail && i<c;i++){
+		*in >> (*vals)[i];
 	}
 	
-	if(f->fail()){
+	if(fail || in->fail()){
 		L_ERR("[Tree::read_intr]-(cannot read file)");
 		delete keys;
 		delete vals;
@@ -267,12 +736,15 @@ forest::details::tree_intr_read_t forest::details::Tree::read_intr(string filena
 
 forest::details::tree_leaf_read_t forest::details::Tree::read_leaf(string filename)
 {	
-	// Wait for file to be ready
+	// Wait for file to be ready, cache miss goes ahead of the saves
 	savior->get(filename);
+	IOScheduler::ticket io(IOScheduler::IO_CLASS::READ);
+	latency_timer timer(metrics.node_load);
 	
 	DBFS::File* f = new DBFS::File(filename);
 	
 	int c;
+	int flags = 0;
 	string left_leaf, right_leaf;
 	uint_t start_data;
 	
@@ -281,27 +753,121 @@ forest::details::tree_leaf_read_t forest::details::Tree::read_leaf(string filena
 	f->read(left_leaf);
 	f->read(right_leaf);
 	
+	// Flags are optional and end the first line
+	if(f->stream().peek() == ' '){
+		f->read(flags);
+	}
+	
+	string head = to_string(c) + " " + left_leaf + " " + right_leaf;
+	
+	// Negative count marks leaf referencing the value log
+	bool has_refs = c < 0;
+	if(has_refs){
+		c = -c;
+	}
+	
 	auto* keys = new std::vector<tree_t::key_type>(c);
 	auto* vals_lengths = new std::vector<uint_t>(c);
-	for(int i=0;i<c;i++){
-		f->read((*keys)[i]);
+	std::vector<int_t>* segments = nullptr;
+	std::vector<uint_t>* offsets = nullptr;
+	std::vector<uint_t>* raws = nullptr;
+	if(has_refs){
+		segments = new std::vector<int_t>(c);
+		offsets = new std::vector<uint_t>(c);
 	}
-	for(int i=0;i<c;i++){
-		f->read((*vals_lengths)[i]);
+	std::vector<int_t>* sums = nullptr;
+	if(flags & LEAF_FLAG_PACKED_VALUES){
+		raws = new std::vector<uint_t>(c);
+	}
+	if(flags & LEAF_FLAG_VALUE_CHECKSUMS){
+		sums = new std::vector<int_t>(c);
 	}
-	start_data = f->tellg()+1;
 	
-	if(f->fail()){
+	auto read_sections = [&](auto&& rd){
+		for(int i=0;i<c;i++){
+			rd((*keys)[i]);
+		}
+		for(int i=0;i<c;i++){
+			rd((*vals_lengths)[i]);
+		}
+		if(segments){
+			for(int i=0;i<c;i++){
+				rd((*segments)[i]);
+				rd((*offsets)[i]);
+			}
+		}
+		if(raws){
+			for(int i=0;i<c;i++){
+				rd((*raws)[i]);
+			}
+		}
+		if(sums){
+			for(int i=0;i<c;i++){
+				rd((*sums)[i]);
+			}
+		}
+	};
+	
+	bool fail = false;
+	if(flags & (LEAF_FLAG_PACKED_KEYS | LEAF_FLAG_CHECKSUM)){
+		// Sections are stored as one block right after the first line
+		bool packed = flags & LEAF_FLAG_PACKED_KEYS;
+		uint_t raw_size, stored_size, crc = 0;
+		f->read(raw_size);
+		stored_size = raw_size;
+		if(packed){
+			f->read(stored_size);
+		}
+		if(flags & LEAF_FLAG_CHECKSUM){
+			f->read(crc);
+		}
+		f->stream().get();
+		
+		string stored(stored_size, '\0');
+		f->read(&stored[0], stored_size);
+		start_data = f->tellg();
+		fail = f->fail();
+		
+		if(!fail && (flags & LEAF_FLAG_CHECKSUM) && crc32c(crc32c(head), stored) != crc){
+			L_ERR("[Tree::read_leaf]-(checksum mismatch)");
+			fail = true;
+		}
+		
+		if(!fail){
+			try{
+				std::istringstream block(packed ? decompress_block(stored.data(), stored_size, raw_size) : stored);
+				read_sections([&block](auto& v){ block >> v; });
+				fail = block.fail();
+			} catch(TreeException& e){
+				fail = true;
+			}
+		}
+	} else {
+		read_sections([f](auto& v){ f->read(v); });
+		start_data = f->tellg()+1;
+		fail = f->fail();
+	}
+	
+	if(fail){
 		L_ERR("[Tree::read_leaf]-(cannot read file)");
 		delete keys;
 		delete vals_lengths;
+		delete segments;
+		delete offsets;
+		delete raws;
+		delete sums;
 		delete f;
 		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
 	}
+	io.set_bytes(start_data);
 	
 	tree_leaf_read_t t;
 	t.child_keys = keys;
 	t.child_lengths = vals_lengths;
+	t.child_segments = segments;
+	t.child_offsets = offsets;
+	t.child_raws = raws;
+	t.child_sums = sums;
 	t.left_leaf = left_leaf;
 	t.right_leaf = right_leaf;
 	t.start_data = start_data;
@@ -325,6 +891,7 @@ void forest::details::Tree::materialize_intr(tree_t::node_ptr node)
 		/// lock{
 		n = tree_t::node_ptr(new tree_t::InternalNode(node->get_keys(), node->get_nodes()));
 		set_node_data(n, create_node_data(true, temp_path));
+		get_data(n).owner = this;
 		data = create_node_data(false, temp_path);
 		set_node_data(node, data);
 		cache::intr_insert(n);
@@ -386,6 +953,8 @@ void forest::details::Tree::materialize_leaf(tree_t::node_ptr node)
 		/// lock{
 		n = tree_t::node_ptr(new tree_t::LeafNode(node->get_childs()));
 		set_node_data(n, create_node_data(true, temp_path));
+		get_data(n).compression = compression;
+		get_data(n).owner = this;
 		data = create_node_data(false, temp_path);
 		set_node_data(node, data);
 		cache::leaf_insert(n);
@@ -558,15 +1127,140 @@ void forest::details::Tree::set_type(TREE_TYPES type)
 	this->type = type;
 }
 
+bool forest::details::Tree::owns(tree_t::node_ptr node)
+{
+	return get_data(node).owner == this;
+}
+
+forest::COMPRESSION_TYPES forest::details::Tree::get_compression()
+{
+	return compression->type;
+}
+
+void forest::details::Tree::set_compression(COMPRESSION_TYPES compression)
+{
+	this->compression->type = compression;
+}
+
+std::vector<forest::details::uint_t> forest::details::Tree::get_dictionaries()
+{
+	std::lock_guard<mutex> lock(compression->mtx);
+	return compression->dicts;
+}
+
+void forest::details::Tree::set_dictionaries(std::vector<uint_t> dicts)
+{
+	std::lock_guard<mutex> lock(compression->mtx);
+	compression->dicts = std::move(dicts);
+	compression->dict = compression->dicts.size() ? compression->dicts.back() : 0;
+}
+
+void forest::details::Tree::train_dictionary()
+{
+	if(compression->type == COMPRESSION_TYPES::NONE){
+		throw TreeException(TreeException::ERRORS::BAD_INPUT_PARAMETER);
+	}
+	
+	std::vector<string> samples = sample_values(DICT_SAMPLES);
+	uint_t id = dictionaries->train(samples);
+	
+	{
+		std::lock_guard<mutex> lock(compression->mtx);
+		if(compression->dict){
+			dictionaries->reset(compression->dict);
+		}
+		if(id){
+			dictionaries->reset(id);
+		}
+		if(compression->dropped){
+			if(id){
+				dictionaries->release(id);
+			}
+			return;
+		}
+		// Older dictionaries are still needed by values packed with them.
+		// The tree keeps one reference to every dictionary in its list.
+		if(id){
+			auto it = std::find(compression->dicts.begin(), compression->dicts.end(), id);
+			if(it != compression->dicts.end()){
+				compression->dicts.erase(it);
+				dictionaries->release(id);
+			}
+			compression->dicts.push_back(id);
+			compression->dict = id;
+		}
+		compression->stale = false;
+		compression->training = false;
+	}
+	
+	if(id){
+		base_changed();
+	}
+}
+
+void forest::details::Tree::drop_dictionaries()
+{
+	std::lock_guard<mutex> lock(compression->mtx);
+	compression->dropped = true;
+	compression->dict = 0;
+	for(auto id : compression->dicts){
+		dictionaries->release(id);
+	}
+	compression->dicts.clear();
+}
+
+void forest::details::Tree::check_dictionary()
+{
+	// Rebuild dictionary in background once leafs saw it degraded
+	if(!compression->stale || compression->training.exchange(true)){
+		return;
+	}
+	tree_ptr self = get_self();
+	dictionaries->schedule([self](){
+		try{
+			self->train_dictionary();
+		} catch(...){
+			L_ERR("[Tree::check_dictionary]-(cannot rebuild dictionary)");
+			self->compression->training = false;
+		}
+	});
+}
+
+std::vector<forest::details::string> forest::details::Tree::sample_values(int count)
+{
+	// Take values evenly spread over the whole tree
+	uint_t total = std::max(counters.count.get(), (int_t)0);
+	uint_t step = std::max((uint_t)1, total / std::max(count, 1));
+	uint_t limit = (uint_t)DICT_BYTES * 100;
+	uint_t taken = 0, i = 0;
+	
+	std::vector<string> samples;
+	tree_t::iterator it = tree->lower_bound("");
+	while(!it.expired() && (int)samples.size() < count && taken < limit){
+		if(i++ % step == 0){
+			tree_t::val_type& val = it->second;
+			string s(std::min(val->size(), (uint_t)LEAF_BUFFER_BYTES), '\0');
+			val->get_reader().read(&s[0], s.size());
+			taken += s.size();
+			samples.push_back(std::move(s));
+		}
+		++it;
+	}
+	
+	return samples;
+}
+
 forest::details::tree_t::node_ptr forest::details::Tree::get_intr(string path)
 {	
 	node_ptr intr_data;
 	
 	// Check reference
 	if(cache::intr_cache_r.count(path)){
+		metrics.intr_cache_hits.add(1);
 		intr_data = cache::intr_cache_r[path]->first;
 		return intr_data;
 	}
+	metrics.intr_cache_misses.add(1);
 	
 	// Create and lock node
 	intr_data = node_ptr(new tree_t::InternalNode());
@@ -576,6 +1270,8 @@ forest::details::tree_t::node_ptr forest::details::Tree::get_intr(string path)
 	
 	node_data.is_original = true;
 	node_data.cached_ref = cache_obj;
+	node_data.compression = compression;
+	node_data.owner = this;
 	
 	// Put it into the cache
 	cache::intr_cache_r[path] = cache_obj;
@@ -619,9 +1315,11 @@ forest::details::tree_t::node_ptr forest::details::Tree::get_leaf(string path)
 	
 	// Check reference
 	if(cache::leaf_cache_r.count(path)){
+		metrics.leaf_cache_hits.add(1);
 		leaf_data = cache::leaf_cache_r[path]->first;
 		return leaf_data;
 	}
+	metrics.leaf_cache_misses.add(1);
 
 	// Create and lock node
 	leaf_data = node_ptr(new typename tree_t::LeafNode());
@@ -632,6 +1330,8 @@ forest::details::tree_t::node_ptr forest::details::Tree::get_leaf(string path)
 	
 	node_data.is_original = true;
 	node_data.cached_ref = cache_obj;
+	node_data.compression = compression;
+	node_data.owner = this;
 	
 	// Put it into the cache
 	cache::leaf_cache_r[path] = cache_obj;
@@ -640,21 +1340,20 @@ forest::details::tree_t::node_ptr forest::details::Tree::get_leaf(string path)
 	// Fill data
 	tree_leaf_read_t leaf_d = read_leaf(path);
 	std::vector<tree_t::key_type>* keys_ptr = leaf_d.child_keys;
-	std::vector<uint_t>* vals_length = leaf_d.child_lengths;
-	uint_t start_data = leaf_d.start_data;
 	file_ptr f(leaf_d.file);
 	get_data(leaf_data).f = f;
+	std::vector<file_data_ptr> vals = leaf_values(leaf_d, f);
 	int c = keys_ptr->size();
-	uint_t last_len = 0;
 	
 	for(int i=0;i<c;i++){
-		leaf_data->insert(this->tree->create_entry_item( (*keys_ptr)[i], file_data_ptr(new file_data_t(f, start_data+last_len, (*vals_length)[i])) ));
-		last_len += (*vals_length)[i];
+		if(vals[i]->get_segment() >= 0){
+			node_data.log_refs.push_back(std::make_pair(vals[i]->get_segment(), vals[i]->size()));
+		}
+		leaf_data->insert(this->tree->create_entry_item( (*keys_ptr)[i], vals[i] ));
 	}
 	
 	// Clear memory
 	delete keys_ptr;
-	delete vals_length;
 	
 	// Update records positions
 	auto childs = leaf_data->get_childs();
@@ -751,7 +1450,7 @@ forest::details::tree_t::node_ptr forest::details::Tree::extract_locked_node(tre
 }
 
 
-void forest::details::Tree::save_intr(node_ptr node, DBFS::File* f)
+forest::details::uint_t forest::details::Tree::save_intr(node_ptr node, DBFS::File* f)
 {
 	tree_intr_read_t intr_d;
 	intr_d.childs_type = ((node->first_child_node()->is_leaf()) ? NODE_TYPES::LEAF : NODE_TYPES::INTR);
@@ -767,46 +1466,140 @@ void forest::details::Tree::save_intr(node_ptr node, DBFS::File* f)
 	intr_d.child_values = nodes;
 	write_intr(f, intr_d);
 	
+	uint_t written = f->tellp();
 	f->close();
+	return written;
 }
 
 void forest::details::Tree::save_leaf(node_ptr node, file_ptr fp)
 {	
-	tree_leaf_read_t leaf_d;
-	auto* keys = new std::vector<tree_t::key_type>();
-	auto* lengths = new std::vector<uint_t>();
-	
+	leaf_save_t save;
 	node_data_ptr data = get_node_data(node);
 	
-	leaf_d.left_leaf = data->prev;
-	leaf_d.right_leaf = data->next;
+	save.leaf_d.left_leaf = data->prev;
+	save.leaf_d.right_leaf = data->next;
 	
-	auto* childs = node->get_childs();
-	tree_t::childs_type_iterator start;
+	save.buf_size = CHUNK_SIZE;
+	save.buf = new char[save.buf_size];
 	
-	start = childs->begin();
-	while(start != childs->end()){
-		keys->push_back(start->data->item->first);
-		lengths->push_back(start->data->item->second->size());
-		start = childs->find_next(start);
+	ValueLog::refs_t released;
+	
+	try{
+		encode_leaf_values(node, save);
+		released = acquire_leaf_refs(node, save);
+		
+		// Header and cached values are collected into one buffer and
+		// written at once, only values stored in files are streamed
+		string out;
+		out.reserve(LEAF_BUFFER_BYTES);
+		write_leaf_header(node, save, out);
+		write_leaf_values(node, fp, save, out);
+	} catch(...){
+		delete[] save.buf;
+		throw;
 	}
 	
-	leaf_d.child_keys = keys;
-	leaf_d.child_lengths = lengths;
-	write_leaf(fp, leaf_d);
+	delete[] save.buf;
+	fp->stream().flush();
 	
-	auto lock = fp->get_lock();
+	// Previous file does not reference released values anymore
+	get_data(node).log_refs = std::move(save.refs);
+	value_log->release(released);
+}
+
+void forest::details::Tree::encode_leaf_values(node_ptr node, leaf_save_t& save)
+{
+	auto* keys = new std::vector<tree_t::key_type>();
+	auto* lengths = new std::vector<uint_t>();
+	auto* childs = node->get_childs();
 	
-	start = childs->begin();
-	while(start != childs->end()){
-		write_leaf_item(fp, start->data->item->second);
-		start = childs->find_next(start);
+	// Values packed in memory wait in save.packed until they are written
+	tree_compression_ptr packing = get_data(node).compression;
+	COMPRESSION_TYPES compression = packing ? packing->type : COMPRESSION_TYPES::NONE;
+	uint_t dict = packing ? packing->dict.load() : 0;
+	uint_t min_packed = dict ? DICT_VALUE_BYTES : COMPRESS_VALUE_BYTES;
+	ZSTD_CDict* cdict = nullptr;
+	
+	try{
+		if(dict){
+			cdict = dictionaries->get_cdict(dict);
+		}
+		auto start = childs->begin();
+		while(start != childs->end()){
+			tree_t::val_type& val = start->data->item->second;
+			keys->push_back(start->data->item->first);
+			// Large values go to the value log before leaf refers them.
+			// Appended values are already accounted by the log itself.
+			if(value_log->needs_move(val)){
+				value_log->append(val, save.buf, save.buf_size);
+				save.delta[val->get_segment()];
+				save.appended = true;
+			} else if(val->get_segment() >= 0){
+				save.delta[val->get_segment()] += val->size();
+			}
+			if(val->get_segment() >= 0){
+				save.refs.push_back(std::make_pair(val->get_segment(), val->size()));
+				lengths->push_back(val->size());
+			} else {
+				if(compression != COMPRESSION_TYPES::NONE && !val->get_packed() && val->size() >= min_packed){
+					string mem;
+					bool in_mem = pack_value(val, save.buf, save.buf_size, mem, cdict);
+					if(dict && val->size() <= (uint_t)LEAF_BUFFER_BYTES){
+						dictionaries->account(dict, val->size(), in_mem ? mem.size() : val->size());
+					}
+					if(in_mem){
+						save.packed[val.get()] = std::move(mem);
+					}
+				}
+				if(VALUE_CHECKSUMS && val->get_checksum() < 0 && val->is_cached()){
+					val->set_checksum(value_checksum(val, save.buf, save.buf_size));
+				}
+				auto it = save.packed.find(val.get());
+				lengths->push_back(it != save.packed.end() ? it->second.size() : val->stored_size());
+				save.has_packed = save.has_packed || val->get_packed() || it != save.packed.end();
+			}
+			start = childs->find_next(start);
+		}
+	} catch(...){
+		delete keys;
+		delete lengths;
+		throw;
 	}
 	
-	fp->stream().flush();
+	if(dict && dictionaries->degraded(dict)){
+		packing->stale = true;
+	}
+	
+	save.leaf_d.child_keys = keys;
+	save.leaf_d.child_lengths = lengths;
+	save.leaf_d.pack_keys = compression != COMPRESSION_TYPES::NONE;
+}
+
+forest::details::ValueLog::refs_t forest::details::Tree::acquire_leaf_refs(node_ptr node, leaf_save_t& save)
+{
+	ValueLog::refs_t acquired, released;
+	for(auto& ref : get_data(node).log_refs){
+		save.delta[ref.first] -= ref.second;
+	}
+	// Unchanged segments are acquired too, so the log knows this tree
+	// references them
+	bool acquiring = save.appended;
+	for(auto& d : save.delta){
+		if(d.second >= 0){
+			acquired.push_back(std::make_pair(d.first, d.second));
+			acquiring = acquiring || d.second > 0;
+		} else {
+			released.push_back(std::make_pair(d.first, -d.second));
+		}
+	}
+	if(acquiring){
+		Tree* owner = get_data(node).owner;
+		value_log->acquire(acquired, owner ? owner->get_name() : "");
+	}
+	return released;
 }
 
-void forest::details::Tree::save_base(tree_ptr tree, DBFS::File* base_f)
+forest::details::uint_t forest::details::Tree::save_base(tree_ptr tree, DBFS::File* base_f)
 {
 	tree_base_read_t base_d;
 	base_d.type = tree->get_type();
@@ -826,8 +1619,18 @@ void forest::details::Tree::save_base(tree_ptr tree, DBFS::File* base_f)
 	
 	base_d.annotation = tree->annotation;
 	
+	tree_stats_t stats = tree->get_stats();
+	base_d.bytes = stats.bytes;
+	base_d.leafs = stats.leafs;
+	base_d.depth = stats.depth;
+	base_d.compression = tree->get_compression();
+	base_d.dicts = tree->get_dictionaries();
+	
 	write_base(base_f, base_d);
+	
+	uint_t written = base_f->tellp();
 	base_f->close();
+	return written;
 }
 
 
@@ -835,18 +1638,19 @@ void forest::details::Tree::write_intr(DBFS::File* file, tree_intr_read_t data)
 {
 	auto* keys = data.child_keys;
 	auto* paths = data.child_values;
-	file->write( to_string((int)data.childs_type) + " " + to_string(paths->size()) + "\n" );
+	string head = to_string((int)data.childs_type) + " " + to_string(paths->size());
 	
-	string valsStr = "";
-	std::stringstream ss;
+	string block = "";
 	for(auto& key : (*keys)){
-		ss << key << " ";
+		block.append(key + " ");
 	}
+	block.push_back('\n');
 	for(auto& val : (*paths)){
-		valsStr.append(val + " ");
+		block.append(val + " ");
 	}
-	file->write(ss.str() + "\n");
-	file->write(valsStr);
+	
+	file->write(head + " " + std::to_string(block.size()) + " " + std::to_string(crc32c(crc32c(head), block)) + "\n");
+	file->write(block);
 	
 	// Clear memory
 	delete keys;
@@ -860,64 +1664,357 @@ void forest::details::Tree::write_intr(DBFS::File* file, tree_intr_read_t data)
 
 void forest::details::Tree::write_base(DBFS::File* file, tree_base_read_t data)
 {
-	file->write( to_string(data.count) + " " + to_string(data.factor) + " " + to_string((int)data.type) + " " + data.branch + " " + to_string((int)data.branch_type) + " " + to_string(data.annotation.size()) + " " + data.annotation + "\n" );
+	string body = to_string(data.count) + " " + to_string(data.factor) + " " + to_string((int)data.type) + " " + data.branch + " " + to_string((int)data.branch_type) + " " + to_string(data.annotation.size()) + " " + data.annotation + "\n";
+	string dicts = to_string(data.dicts.size());
+	for(auto id : data.dicts){
+		dicts.append(" " + std::to_string(id));
+	}
+	body.append( std::to_string(data.bytes) + " " + std::to_string(data.leafs) + " " + to_string(data.depth) + " " + to_string((int)data.compression) + " " + dicts + "\n" );
+	
+	file->write("#" + std::to_string(crc32c(body)) + " " + std::to_string(body.size()) + "\n");
+	file->write(body);
 	if(file->fail()){
 		L_ERR("[Tree::write_base]-(cannot write file)");
 		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
 	}
 }
 
-void forest::details::Tree::write_leaf(file_ptr file, tree_leaf_read_t data)
+void forest::details::Tree::write_leaf(string& out, tree_leaf_read_t data)
 {
 	auto* keys = data.child_keys;
 	auto* lengths = data.child_lengths;
 	int c = keys->size();
-	file->write(to_string(c) + " " + data.left_leaf + " " + data.right_leaf+ "\n");
-	string lenStr = "";
-	std::stringstream ss;
-	for(auto& key : (*keys)){
-		ss << key << " ";
+	
+	int flags = LEAF_FLAG_CHECKSUM;
+	if(data.pack_keys){
+		flags |= LEAF_FLAG_PACKED_KEYS;
+	}
+	if(data.child_raws){
+		flags |= LEAF_FLAG_PACKED_VALUES;
+	}
+	if(data.child_sums){
+		flags |= LEAF_FLAG_VALUE_CHECKSUMS;
+	}
+	
+	string head = to_string(data.child_segments ? -c : c) + " " + data.left_leaf + " " + data.right_leaf;
+	
+	// Sections are collected into one block to be checksummed and maybe packed
+	string block;
+	
+	for(int i=0;i<c;i++){
+		if(i){
+			block.push_back(' ');
+		}
+		block.append((*keys)[i]);
 	}
-	for(auto& len : (*lengths)){
-		lenStr.append(to_string(len) + " ");
+	block.append(" \n");
+	
+	for(int i=0;i<c;i++){
+		if(i){
+			block.push_back(' ');
+		}
+		block.append(std::to_string((*lengths)[i]));
+	}
+	block.push_back('\n');
+	
+	if(data.child_segments){
+		for(int i=0;i<c;i++){
+			if(i){
+				block.push_back(' ');
+			}
+			block.append(std::to_string((*data.child_segments)[i]) + " " + std::to_string((*data.child_offsets)[i]));
+		}
+		block.push_back('\n');
+	}
+	
+	if(data.child_raws){
+		for(int i=0;i<c;i++){
+			if(i){
+				block.push_back(' ');
+			}
+			block.append(std::to_string((*data.child_raws)[i]));
+		}
+		block.push_back('\n');
 	}
-	if(lenStr.size()){
-		lenStr.pop_back();
+	
+	if(data.child_sums){
+		for(int i=0;i<c;i++){
+			if(i){
+				block.push_back(' ');
+			}
+			block.append(std::to_string((*data.child_sums)[i]));
+		}
+		block.push_back('\n');
 	}
-	file->write(ss.str()+"\n");
-	file->write(lenStr+"\n");
 	
 	// Clear memory
 	delete keys;
 	delete lengths;
+	delete data.child_segments;
+	delete data.child_offsets;
+	delete data.child_raws;
+	delete data.child_sums;
+	
+	string sizes = std::to_string(block.size());
+	if(data.pack_keys){
+		block = compress_block(block.data(), block.size());
+		sizes.append(" " + std::to_string(block.size()));
+	}
+	
+	out.append(head + " " + to_string(flags) + " " + sizes + " " + std::to_string(crc32c(crc32c(head), block)) + "\n");
+	out.append(block);
+}
+
+void forest::details::Tree::write_leaf_header(node_ptr node, leaf_save_t& save, string& out)
+{
+	tree_leaf_read_t& leaf_d = save.leaf_d;
+	auto* childs = node->get_childs();
+	tree_t::childs_type_iterator start;
+	
+	if(save.refs.size()){
+		leaf_d.child_segments = new std::vector<int_t>();
+		leaf_d.child_offsets = new std::vector<uint_t>();
+		start = childs->begin();
+		while(start != childs->end()){
+			tree_t::val_type& val = start->data->item->second;
+			leaf_d.child_segments->push_back(val->get_segment());
+			leaf_d.child_offsets->push_back(val->get_segment() >= 0 ? val->get_start() : 0);
+			start = childs->find_next(start);
+		}
+	}
+	
+	if(VALUE_CHECKSUMS){
+		leaf_d.child_sums = new std::vector<int_t>();
+		start = childs->begin();
+		while(start != childs->end()){
+			leaf_d.child_sums->push_back(start->data->item->second->get_checksum());
+			start = childs->find_next(start);
+		}
+	}
+	
+	if(save.has_packed){
+		leaf_d.child_raws = new std::vector<uint_t>();
+		start = childs->begin();
+		while(start != childs->end()){
+			tree_t::val_type& val = start->data->item->second;
+			bool is_packed = val->get_segment() < 0 && (val->get_packed() || save.packed.count(val.get()));
+			leaf_d.child_raws->push_back(is_packed ? val->size() : 0);
+			start = childs->find_next(start);
+		}
+	}
+	
+	write_leaf(out, leaf_d);
+}
+
+void forest::details::Tree::write_leaf_values(node_ptr node, file_ptr fp, leaf_save_t& save, string& out)
+{
+	auto* childs = node->get_childs();
+	auto& packed = save.packed;
+	
+	auto lock = fp->get_lock();
+	int_t out_start = fp->tellp();
+	
+	// Values that were not changed lie one by one in the previous
+	// file, so copy every such run at once instead of value by value
+	std::vector<tree_t::val_type> run;
+	std::vector<std::unique_lock<mutex>> run_locks;
+	
+	auto start = childs->begin();
+	while(start != childs->end()){
+		tree_t::val_type& val = start->data->item->second;
+		if(val->get_segment() >= 0){
+			start = childs->find_next(start);
+			continue;
+		}
+		auto val_lock = val->get_lock();
+		
+		// Packed values are copied as they are, even when cached
+		auto mem = packed.find(val.get());
+		bool in_file = mem == packed.end() && val->file && (!val->is_cached() || val->get_packed());
+		bool buffered = mem != packed.end() || (!in_file && val->is_cached() && val->size() <= (uint_t)LEAF_BUFFER_BYTES);
+		if(run.size() && in_file && val->file == run.back()->file && val->get_start() == run.back()->get_start() + run.back()->stored_size()){
+			run.push_back(val);
+			run_locks.push_back(std::move(val_lock));
+		} else {
+			if(run.size()){
+				write_leaf_run(fp, run, save.buf, save.buf_size);
+				run.clear();
+				run_locks.clear();
+			}
+			if(!buffered){
+				write_leaf_buffer(fp, out);
+			}
+			if(in_file){
+				run.push_back(val);
+				run_locks.push_back(std::move(val_lock));
+			} else if(buffered){
+				if(!out.size()){
+					out_start = fp->tellp();
+				}
+				uint_t pos = out.size();
+				if(mem != packed.end()){
+					out.append(mem->second);
+					val->set_start(out_start + pos);
+					val->set_file(fp);
+					val->set_packed(mem->second.size());
+					val_lock.unlock();
+				} else {
+					val_lock.unlock();
+					out.resize(pos + val->size());
+					val->get_reader().read(&out[pos], val->size());
+					val->set_start(out_start + pos);
+					val->set_file(fp);
+				}
+				value_cache.adopt(val.get());
+				if(out.size() >= (uint_t)LEAF_BUFFER_BYTES){
+					write_leaf_buffer(fp, out);
+				}
+			} else {
+				val_lock.unlock();
+				write_leaf_item(fp, val, save.buf, save.buf_size);
+			}
+		}
+		start = childs->find_next(start);
+	}
+	if(run.size()){
+		write_leaf_run(fp, run, save.buf, save.buf_size);
+	}
+	write_leaf_buffer(fp, out);
+}
+
+void forest::details::Tree::write_leaf_buffer(file_ptr file, string& out)
+{
+	if(!out.size()){
+		return;
+	}
+	
+	file->write(out.data(), out.size());
+	out.clear();
 	
 	if(file->fail()){
-		L_ERR("[Tree::write_leaf]-(cannot write file)");
+		L_ERR("[Tree::write_leaf_buffer]-(cannot write file)");
 		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
 	}
 }
 
-void forest::details::Tree::write_leaf_item(file_ptr file, tree_t::val_type& data)
+void forest::details::Tree::write_leaf_item(file_ptr file, tree_t::val_type& data, char* buf, int buf_size)
 {
 	int_t start_data = file->tellp();
 	
-	int read_size = CHUNK_SIZE;
-	char* buf = new char[read_size];
-	int rsz;
-	auto reader = data->get_reader();
+	// Reader holds the lock of the value, adopting must go without it
+	{
+		int rsz;
+		auto reader = data->get_reader();
+		
+		try{
+			while( (rsz = reader.read(buf, buf_size)) ){
+				file->write(buf, rsz);
+			}
+		} catch(...){
+			L_ERR("[Tree::write_leaf_item]-(cannot write file)");
+			throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+		}
+	}
 	
+	bool cached;
+	{
+		auto lock = data->get_lock();
+		data->set_start(start_data);
+		data->set_file(file);
+		data->set_packed(0);
+		cached = data->is_cached();
+	}
+	if(cached){
+		value_cache.adopt(data.get());
+	}
+}
+
+void forest::details::Tree::write_leaf_run(file_ptr file, std::vector<tree_t::val_type>& run, char* buf, int buf_size)
+{
+	// Values of the run must be locked by the caller
+	int_t start_data = file->tellp();
+	uint_t run_start = run.front()->get_start();
+	uint_t left = run.back()->get_start() + run.back()->stored_size() - run_start;
+	file_ptr src = run.front()->file;
+	
+	// Short read would copy garbage into the new leaf, so it fails the save
+	bool read_failed = false;
 	try{
-		while( (rsz = reader.read(buf, read_size)) ){
-			file->write(buf, rsz);
+		auto lock = src->get_lock();
+		src->seekg(run_start);
+		while(left){
+			int sz = (int)std::min(left, (uint_t)buf_size);
+			src->read(buf, sz);
+			if(src->fail() || src->stream().gcount() != sz){
+				read_failed = true;
+				break;
+			}
+			file->write(buf, sz);
+			left -= sz;
 		}
 	} catch(...){
-		L_ERR("[Tree::write_leaf_item]-(cannot write file)");
+		L_ERR("[Tree::write_leaf_run]-(cannot write file)");
 		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
 	}
+	if(read_failed){
+		L_ERR("[Tree::write_leaf_run]-(cannot read file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
 	
-	delete[] buf;
-	data->set_start(start_data);
-	data->set_file(file);
+	for(auto& val : run){
+		val->set_start(start_data + (val->get_start() - run_start));
+		val->set_file(file);
+	}
+}
+
+forest::details::int_t forest::details::Tree::value_checksum(tree_t::val_type& data, char* buf, int buf_size)
+{
+	uint32_t crc = 0;
+	int rsz;
+	auto reader = data->get_reader();
+	while( (rsz = reader.read(buf, buf_size)) ){
+		crc = crc32c(crc, buf, rsz);
+	}
+	return crc;
+}
+
+bool forest::details::Tree::pack_value(tree_t::val_type& data, char* buf, int buf_size, string& out, ZSTD_CDict* dict)
+{
+	uint_t size = data->size();
+	
+	// Small values are packed in memory and written with the leaf buffer
+	if(size <= (uint_t)LEAF_BUFFER_BYTES){
+		compress_value(data, buf, buf_size, [&out](const char* chunk, uint_t sz){
+			out.append(chunk, sz);
+		}, dict);
+		return out.size() < size;
+	}
+	
+	// Large ones go through a temporary file, so they are never held in memory
+	file_ptr file = file_ptr(DBFS::create());
+	if(file->fail()){
+		L_ERR("[Tree::pack_value]-(cannot create file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_CREATE_FILE);
+	}
+	file->on_close([](DBFS::File* file){ savior->remove_file_async(file->name()); });
+	
+	uint_t packed_size = compress_value(data, buf, buf_size, [&file](const char* chunk, uint_t sz){
+		file->write(chunk, sz);
+	}, dict);
+	
+	file->stream().flush();
+	if(file->fail()){
+		L_ERR("[Tree::pack_value]-(cannot write file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	
+	if(packed_size < size){
+		auto lock = data->get_lock();
+		data->set_file(file);
+		data->set_start(0);
+		data->set_packed(packed_size);
+	}
+	return false;
 }
 
 // Proceed
@@ -929,12 +2026,22 @@ void forest::details::Tree::d_enter(tree_t::node_ptr& node, tree_t::PROCESS_TYPE
 	
 	// Nothing to do with stem
 	if(tree->is_stem_pub(node)){
+		descent.tree = this;
+		descent.depth = 0;
 		return;
 	}
 	
 	if(!node->is_leaf()){
+		if(descent.tree == this){
+			++descent.depth;
+		}
 		materialize_intr(node);
 	} else {
+		if(descent.tree == this){
+			// Depth of the tree observed by the last descent
+			counters.depth.store(descent.depth + 1, std::memory_order_relaxed);
+			descent.tree = nullptr;
+		}
 		materialize_leaf(node);
 	}
 	DP_LOG_END(p, h_enter);
@@ -969,6 +2076,15 @@ void forest::details::Tree::d_insert(tree_t::node_ptr& node)
 		
 		node_data_ptr data = get_node_data(node);
 		string cur_name = data->path;
+		
+		// Changed children have to be published together with the node
+		std::vector<string> childs;
+		for(auto& child : *(node->get_nodes())){
+			if(has_data(child)){
+				childs.push_back(get_node_data(child)->path);
+			}
+		}
+		savior->link(cur_name, childs, true);
 		savior->put(cur_name, SAVE_TYPES::INTR, n);
 	} else {
 		
@@ -1251,6 +2367,9 @@ void forest::details::Tree::d_leaf_insert(tree_t::node_ptr& node, tree_t::child_
 	
 	// Lock both at once
 	change_lock_bunch(node, item, true);
+	
+	counters.count.add(1);
+	counters.bytes.add(item->item->second->counted_size());
 	DP_LOG_END(p, h_l_insert);
 }
 
@@ -1267,11 +2386,26 @@ void forest::details::Tree::d_leaf_delete(tree_t::node_ptr& node, tree_t::child_
 	// Lock both at once
 	change_lock_bunch(node, item);
 	
+	counters.count.sub(1);
+	counters.bytes.sub(item->item->second->counted_size());
+	
 	item->item->second->set_file(nullptr);
 	DP_LOG_END(p, h_l_ref);
 }
 
 void forest::details::Tree::d_leaf_split(tree_t::node_ptr& node, tree_t::node_ptr& new_node, tree_t::node_ptr& link_node)
+{
+	counters.leafs.add(1);
+	d_leaf_link(node, new_node, link_node);
+}
+
+void forest::details::Tree::d_leaf_join(tree_t::node_ptr& node, tree_t::node_ptr& join_node, tree_t::node_ptr& link_node)
+{
+	counters.leafs.sub(1);
+	d_leaf_link(node, join_node, link_node);
+}
+
+void forest::details::Tree::d_leaf_link(tree_t::node_ptr& node, tree_t::node_ptr& new_node, tree_t::node_ptr& link_node)
 {
 	DP_LOG_START(p);
 	if(!link_node){
@@ -1293,11 +2427,6 @@ void forest::details::Tree::d_leaf_split(tree_t::node_ptr& node, tree_t::node_pt
 	DP_LOG_END(p, h_l_ref);
 }
 
-void forest::details::Tree::d_leaf_join(tree_t::node_ptr& node, tree_t::node_ptr& join_node, tree_t::node_ptr& link_node)
-{
-	d_leaf_split(node, join_node, link_node);
-}
-
 void forest::details::Tree::d_leaf_shift(tree_t::node_ptr& node, tree_t::node_ptr& shift_node)
 {	
 	DP_LOG_START(p);
@@ -1372,6 +2501,11 @@ void forest::details::Tree::d_leaf_ref(tree_t::node_ptr& node, tree_t::node_ptr&
 		/// }lock
 		cache::leaf_unlock();
 	}
+	if(data){
+		// Linked leafs are published together
+		savior->link(data->path, {ref_path});
+	}
+	
 	if(ref == tree_t::LEAF_REF::NEXT){
 		node->set_next_leaf(ref_node);
 		if(data){
@@ -1389,18 +2523,35 @@ void forest::details::Tree::d_leaf_ref(tree_t::node_ptr& node, tree_t::node_ptr&
 void forest::details::Tree::d_save_base(tree_t::node_ptr& node)
 {
 	DP_LOG_START(p);
-	// Save Base File
-	string base_file_name = this->get_name();
-	
-	tree_ptr t;
-	if(FOREST.get() == this){
-		t = FOREST;	
-	} else {
-		cache::tree_lock();
-		t = this->get_cached().ref->first;
-		cache::tree_unlock();
+	// New root is published together with the base
+	if(node && has_data(node)){
+		savior->link(this->get_name(), {get_node_data(node)->path});
 	}
 	
-	savior->put(base_file_name, SAVE_TYPES::BASE, t);
+	// Save Base File
+	savior->put(this->get_name(), SAVE_TYPES::BASE, get_self());
+	DP_LOG_END(p, h_save_base);
+}
+
+void forest::details::Tree::base_changed()
+{
+	// Base data is read by Savior at the moment of saving,
+	// so it is enough to queue it once until it is saved
+	if(base_dirty.exchange(true)){
+		return;
+	}
+	DP_LOG_START(p);
+	savior->put(this->get_name(), SAVE_TYPES::BASE, get_self());
 	DP_LOG_END(p, h_save_base);
 }
+
+forest::details::tree_ptr forest::details::Tree::get_self()
+{
+	if(FOREST.get() == this){
+		return FOREST;
+	}
+	cache::tree_lock();
+	tree_ptr t = this->get_cached().ref->first;
+	cache::tree_unlock();
+	return t;
+}
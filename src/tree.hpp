@@ -25,6 +25,15 @@
 #include "node_data.hpp"
 #include "lock.hpp"
 #include "savior.hpp"
+#include "counter.hpp"
+#include "value_log.hpp"
+#include "value_cache.hpp"
+#include "compression.hpp"
+#include "dictionary.hpp"
+#include "crc32c.hpp"
+#include "snapshot_log.hpp"
+#include "io_scheduler.hpp"
+#include "transaction_log.hpp"
 
 #ifdef DEBUG_PERF
 extern unsigned long int h_enter, h_leave, h_insert, h_remove, h_reserve,
@@ -37,13 +46,20 @@ namespace details{
 	
 	class LeafRecord;
 	class Savior;
+	class Snapshot;
+	class Transaction;
+	class TransactionLog;
 	
 	extern Savior* savior;
+	extern ValueLog* value_log;
 	
 	class Tree{
 		
 		friend LeafRecord;
 		friend Savior;
+		friend Snapshot;
+		friend Transaction;
+		friend TransactionLog;
 		friend tree_t;
 		
 		using tree_node_type = tree_t::Node::nodes_type;
@@ -54,7 +70,7 @@ namespace details{
 		public:
 			Tree();
 			Tree(string path);
-			Tree(string path, TREE_TYPES type, int factor, string annotation);
+			Tree(string path, TREE_TYPES type, int factor, string annotation, COMPRESSION_TYPES compression = COMPRESSION_TYPES::NONE);
 			~Tree();
 			
 			string get_name();
@@ -72,12 +88,27 @@ namespace details{
 			TREE_TYPES get_type();
 			void set_type(TREE_TYPES type);
 			
+			COMPRESSION_TYPES get_compression();
+			void set_compression(COMPRESSION_TYPES compression);
+			std::vector<uint_t> get_dictionaries();
+			void set_dictionaries(std::vector<uint_t> dicts);
+			void train_dictionary();
+			void drop_dictionaries();
+			
 			tree_t* get_tree();
 			void set_tree(tree_t* tree);
 			
+			tree_stats_t get_stats();
+			verify_report_t verify();
+			bool owns(tree_t::node_ptr node);
+			
 			void insert(tree_t::key_type key, tree_t::val_type val, bool update=false);
 			void erase(tree_t::key_type key);
+			bool cas(tree_t::key_type key, tree_t::val_type expected, tree_t::val_type val);
+			tree_t::val_type merge(tree_t::key_type key, const std::function<tree_t::val_type(tree_t::val_type)>& fn);
+			void merge_delta(tree_t::key_type key, merge_operator_ptr op, string delta);
 			tree_t::iterator find(tree_t::key_type key);
+			std::vector<tree_t::iterator> find(std::vector<tree_t::key_type>& keys);
 			
 			static string seed(TREE_TYPES type, int factor);
 			static string seed(TREE_TYPES type, string path, int factor);
@@ -94,6 +125,24 @@ namespace details{
 				bool iterator_valid = false;
 				std::list<tree_ptr>::iterator iterator;
 			};
+			
+			// Statistics kept without locking the tree
+			struct tree_counters_t{
+				sharded_counter count, bytes, leafs;
+				std::atomic<int> depth = 1;
+			};
+			
+			// Leaf being saved, passed between the saving steps
+			struct leaf_save_t{
+				tree_leaf_read_t leaf_d;
+				ValueLog::refs_t refs;
+				std::unordered_map<int_t, int_t> delta;
+				bool appended = false;
+				std::unordered_map<file_data_t*, string> packed;
+				bool has_packed = false;
+				char* buf = nullptr;
+				int buf_size = 0;
+			};
 		
 			// Intr methods
 			tree_intr_read_t read_intr(string filename);
@@ -102,6 +151,8 @@ namespace details{
 			
 			// Leaf methods
 			tree_leaf_read_t read_leaf(string filename);
+			static std::vector<file_data_ptr> leaf_values(tree_leaf_read_t& leaf_d, file_ptr f);
+			uint_t verify_leaf(string path);
 			void materialize_leaf(tree_t::node_ptr node);
 			void unmaterialize_leaf(tree_t::node_ptr node);
 			
@@ -128,11 +179,16 @@ namespace details{
 			void d_leaf_split(tree_t::node_ptr& node, tree_t::node_ptr& new_node, tree_t::node_ptr& link_node);
 			void d_leaf_join(tree_t::node_ptr& node, tree_t::node_ptr& join_node, tree_t::node_ptr& link_node);
 			void d_leaf_shift(tree_t::node_ptr& node, tree_t::node_ptr& shift_node);
+			void d_leaf_link(tree_t::node_ptr& node, tree_t::node_ptr& new_node, tree_t::node_ptr& link_node);
 			void d_leaf_lock(tree_t::node_ptr& node);
 			void d_leaf_free(tree_t::node_ptr& node);
 			void d_leaf_ref(tree_t::node_ptr& node, tree_t::node_ptr& ref_node, tree_t::LEAF_REF ref);
 			void d_save_base(tree_t::node_ptr& node);
 			
+			// Base
+			void base_changed();
+			tree_ptr get_self();
+			
 			// Getters
 			tree_t::node_ptr get_intr(string path);
 			tree_t::node_ptr get_leaf(string path);
@@ -141,25 +197,48 @@ namespace details{
 			tree_t::node_ptr extract_locked_node(tree_t::child_item_type_ptr item, bool w_prior=false);
 			
 			// Savers
-			static void save_intr(node_ptr node, DBFS::File* f);
+			static uint_t save_intr(node_ptr node, DBFS::File* f);
 			static void save_leaf(node_ptr node, file_ptr fp);
-			static void save_base(tree_ptr tree, DBFS::File* f);
+			static void encode_leaf_values(node_ptr node, leaf_save_t& save);
+			static ValueLog::refs_t acquire_leaf_refs(node_ptr node, leaf_save_t& save);
+			static uint_t save_base(tree_ptr tree, DBFS::File* f);
 			
 			// Writers
 			static void write_intr(DBFS::File* file, tree_intr_read_t data);
 			static void write_base(DBFS::File* file, tree_base_read_t data);
-			static void write_leaf(file_ptr file, tree_leaf_read_t data);
-			static void write_leaf_item(file_ptr file, tree_t::val_type& data);
+			static void write_leaf(string& out, tree_leaf_read_t data);
+			static void write_leaf_header(node_ptr node, leaf_save_t& save, string& out);
+			static void write_leaf_values(node_ptr node, file_ptr fp, leaf_save_t& save, string& out);
+			static void write_leaf_buffer(file_ptr file, string& out);
+			static void write_leaf_item(file_ptr file, tree_t::val_type& data, char* buf, int buf_size);
+			static void write_leaf_run(file_ptr file, std::vector<tree_t::val_type>& run, char* buf, int buf_size);
+			static int_t value_checksum(tree_t::val_type& data, char* buf, int buf_size);
+			static bool pack_value(tree_t::val_type& data, char* buf, int buf_size, string& out, ZSTD_CDict* dict);
 			
 			// Other
+			void versioned(const tree_t::key_type& key, const tree_t::val_type& val, const std::function<void()>& fn);
+			std::unique_lock<mutex> lock_key(const tree_t::key_type& key);
+			void keep_version(const tree_t::key_type& key);
+			tree_t::val_type current(const tree_t::key_type& key);
+			void apply(const tree_t::key_type& key, tree_t::val_type val);
+			void logged_apply(const tree_t::key_type& key, tree_t::val_type val);
+			void logged(const tree_t::key_type& key, const tree_t::val_type& val, const std::function<void()>& fn);
+			void find_sorted(std::vector<tree_t::key_type>& keys, std::vector<size_t>& order, size_t from, size_t to, std::vector<tree_t::iterator>& res);
+			void init_counters(tree_base_read_t& base);
+			std::vector<string> sample_values(int count);
+			void check_dictionary();
 			static tree_t::node_ptr create_node(string path, NODE_TYPES node_type);
 			static tree_t::node_ptr create_node(string path, NODE_TYPES node_type, bool empty);
 			
 			tree_t* tree;
 			TREE_TYPES type;
+			tree_compression_ptr compression = tree_compression_ptr(new tree_compression_t());
 			string name;
 			string annotation;
 			mutex tree_m;
+			std::atomic<bool> base_dirty = false;
+			tree_counters_t counters;
+			SnapshotLog snapshots;
 			
 			tree_cache_t cached;
 	};
@@ -22,6 +22,11 @@ forest::TREE_TYPES forest::details::tree_owner::get_type()
 	return tree->get_type();
 }
 
+forest::COMPRESSION_TYPES forest::details::tree_owner::get_compression()
+{
+	return tree->get_compression();
+}
+
 forest::details::tree_ptr forest::details::tree_owner::get_tree()
 {
 	return tree;
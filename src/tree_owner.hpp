@@ -17,6 +17,7 @@ namespace details{
 
 			string get_annotation();
 			TREE_TYPES get_type();
+			COMPRESSION_TYPES get_compression();
 			
 		private:
 			tree_ptr get_tree();
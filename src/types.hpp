@@ -5,6 +5,7 @@ namespace forest{
 	
 	enum class TREE_TYPES { KEY_STRING };
 	enum class LEAF_POSITION{ BEGIN, END, LOWER, UPPER };
+	enum class COMPRESSION_TYPES { NONE, ZSTD };
 	
 namespace details{
 	
@@ -37,6 +38,8 @@ namespace details{
 	using file_data_ptr = std::shared_ptr<file_data_t>;
 	using detached_leaf_ptr = std::shared_ptr<detached_leaf>;
 	using tree_owner_ptr = std::shared_ptr<tree_owner>;
+	using merge_operator_t = std::function<string(const string* val, const string& delta)>;
+	using merge_operator_ptr = std::shared_ptr<merge_operator_t>;
 	
 	using tree_t = BPlusTree<string, file_data_ptr, Tree, node_addition>;
 	using child_item_type_ptr = tree_t::child_item_type_ptr;
@@ -53,6 +56,11 @@ namespace details{
 	struct tree_leaf_read_t {
 		child_keys_vec_ptr child_keys;
 		child_lengths_vec_ptr child_lengths;
+		std::vector<int_t>* child_segments = nullptr;
+		std::vector<uint_t>* child_offsets = nullptr;
+		std::vector<uint_t>* child_raws = nullptr;
+		std::vector<int_t>* child_sums = nullptr;
+		bool pack_keys = false;
 		uint_t start_data;
 		DBFS::File* file;
 		string left_leaf, right_leaf;
@@ -69,6 +77,33 @@ namespace details{
 		int factor;
 		string branch;
 		string annotation;
+		uint_t bytes;
+		uint_t leafs;
+		int depth;
+		COMPRESSION_TYPES compression;
+		std::vector<uint_t> dicts;
+	};
+	// Compression of the tree shared with all its nodes
+	struct tree_compression_t {
+		COMPRESSION_TYPES type = COMPRESSION_TYPES::NONE;
+		std::atomic<uint_t> dict = 0;
+		std::vector<uint_t> dicts;
+		std::atomic<bool> stale = false;
+		std::atomic<bool> training = false;
+		bool dropped = false;
+		mutex mtx;
+	};
+	using tree_compression_ptr = std::shared_ptr<tree_compression_t>;
+	struct verify_report_t {
+		uint_t nodes = 0;
+		uint_t values = 0;
+		std::vector<string> corrupted;
+	};
+	struct tree_stats_t {
+		uint_t count;
+		uint_t bytes;
+		uint_t leafs;
+		int depth;
 	};
 } // details
 } // forest
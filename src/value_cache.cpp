@@ -0,0 +1,242 @@
+#include "value_cache.hpp"
+
+namespace forest{
+namespace details{
+	
+	ValueCache value_cache;
+	
+} // details
+} // forest
+
+
+forest::details::ValueCache::ValueCache() : shards(new shard_t[SHARDS])
+{
+	// ctor
+}
+
+forest::details::ValueCache::~ValueCache()
+{
+	clear();
+}
+
+void forest::details::ValueCache::touch(file_data_t* data)
+{
+	uint_t k = key(data);
+	{
+		shard_t& shard = get_shard(k);
+		std::lock_guard<mutex> lock(shard.mtx);
+		increment(shard, k);
+	}
+	
+	// Value stays in the shard it joined, even if it moved on the disk since
+	int home = data->value_cache_shard;
+	if(home < 0){
+		return;
+	}
+	shard_t& shard = shards[home];
+	std::lock_guard<mutex> lock(shard.mtx);
+	if(data->value_cache_shard == home){
+		shard.lru.splice(shard.lru.begin(), shard.lru, data->value_cache_it);
+	}
+}
+
+bool forest::details::ValueCache::wants(file_data_t* data)
+{
+	uint_t sz = data->size();
+	if(!VALUE_CACHE_BYTES || sz > (uint_t)CACHE_BYTES || sz > budget()){
+		return false;
+	}
+	
+	uint_t k = key(data);
+	shard_t& shard = get_shard(k);
+	std::lock_guard<mutex> lock(shard.mtx);
+	if(shard.bytes + sz <= budget()){
+		return true;
+	}
+	return shard.lru.size() && frequency(shard, k) > frequency(shard, shard.lru.back()->value_cache_key);
+}
+
+bool forest::details::ValueCache::admit(file_data_t* data)
+{
+	uint_t k = key(data);
+	int index = hash(k, SKETCH_ROWS) % SHARDS;
+	shard_t& shard = shards[index];
+	std::lock_guard<mutex> lock(shard.mtx);
+	if(data->value_cache_shard >= 0){
+		return false;
+	}
+	if(!make_room(shard, data->size(), frequency(shard, k))){
+		return false;
+	}
+	
+	join(index, data);
+	return true;
+}
+
+void forest::details::ValueCache::adopt(file_data_t* data)
+{
+	// Value was cached since its creation (written or merged). It is
+	// evicted like any other value once it has a file to read from
+	uint_t k = key(data);
+	int index = hash(k, SKETCH_ROWS) % SHARDS;
+	shard_t& shard = shards[index];
+	std::lock_guard<mutex> lock(shard.mtx);
+	if(data->value_cache_shard >= 0){
+		return;
+	}
+	
+	// Room is made before the value joins, so it is never its own victim.
+	// Value which does not fit is dropped, or left out of the cache while
+	// it cannot be dropped yet, so the budget always holds
+	if(!make_room(shard, data->size(), -1)){
+		data->try_uncache();
+		return;
+	}
+	
+	join(index, data);
+}
+
+void forest::details::ValueCache::forget(file_data_t* data)
+{
+	int home = data->value_cache_shard;
+	if(home < 0){
+		return;
+	}
+	
+	shard_t& shard = shards[home];
+	std::lock_guard<mutex> lock(shard.mtx);
+	if(data->value_cache_shard != home){
+		return;
+	}
+	shard.lru.erase(data->value_cache_it);
+	leave(shard, data);
+}
+
+void forest::details::ValueCache::clear()
+{
+	for(int i=0;i<SHARDS;i++){
+		shard_t& shard = shards[i];
+		std::lock_guard<mutex> lock(shard.mtx);
+		for(auto* data : shard.lru){
+			data->value_cache_shard = -1;
+		}
+		shard.lru.clear();
+		shard.bytes = 0;
+		std::fill(shard.sketch.begin(), shard.sketch.end(), 0);
+		shard.additions = 0;
+	}
+}
+
+forest::details::uint_t forest::details::ValueCache::size()
+{
+	uint_t res = 0;
+	for(int i=0;i<SHARDS;i++){
+		std::lock_guard<mutex> lock(shards[i].mtx);
+		res += shards[i].bytes;
+	}
+	return res;
+}
+
+forest::details::ValueCache::shard_t& forest::details::ValueCache::get_shard(uint_t key)
+{
+	return shards[hash(key, SKETCH_ROWS) % SHARDS];
+}
+
+void forest::details::ValueCache::join(int shard, file_data_t* data)
+{
+	shard_t& s = shards[shard];
+	s.lru.push_front(data);
+	data->value_cache_it = s.lru.begin();
+	data->value_cache_shard = shard;
+	s.bytes += data->size();
+}
+
+void forest::details::ValueCache::leave(shard_t& shard, file_data_t* data)
+{
+	data->value_cache_shard = -1;
+	shard.bytes -= data->size();
+}
+
+forest::details::uint_t forest::details::ValueCache::key(file_data_t* data)
+{
+	// Values not saved yet are known by their address. The key is kept
+	// in the value to find its frequency when it is a victim
+	uint_t k;
+	if(data->segment >= 0){
+		k = hash((uint_t)data->segment, SKETCH_ROWS + 1) ^ data->start;
+	}
+	else if(data->file){
+		k = std::hash<string>()(data->file->name()) ^ hash(data->start, SKETCH_ROWS + 1);
+	}
+	else{
+		k = (uint_t)(uintptr_t)data;
+	}
+	data->value_cache_key = k;
+	return k;
+}
+
+forest::details::uint_t forest::details::ValueCache::budget()
+{
+	return (uint_t)VALUE_CACHE_BYTES / SHARDS;
+}
+
+int forest::details::ValueCache::frequency(shard_t& shard, uint_t key)
+{
+	int freq = 255;
+	for(int i=0;i<SKETCH_ROWS;i++){
+		freq = std::min(freq, (int)shard.sketch[i * SKETCH_WIDTH + hash(key, i) % SKETCH_WIDTH]);
+	}
+	return freq;
+}
+
+void forest::details::ValueCache::increment(shard_t& shard, uint_t key)
+{
+	for(int i=0;i<SKETCH_ROWS;i++){
+		uint8_t& c = shard.sketch[i * SKETCH_WIDTH + hash(key, i) % SKETCH_WIDTH];
+		if(c < 255){
+			++c;
+		}
+	}
+	if(++shard.additions >= SAMPLE_SIZE){
+		reduce(shard);
+	}
+}
+
+void forest::details::ValueCache::reduce(shard_t& shard)
+{
+	for(auto& c : shard.sketch){
+		c >>= 1;
+	}
+	shard.additions /= 2;
+}
+
+bool forest::details::ValueCache::make_room(shard_t& shard, uint_t need, int freq)
+{
+	// Evict from the tail while the candidate is more valuable, negative
+	// frequency evicts unconditionally. Victims that are being read right
+	// now are skipped.
+	auto it = shard.lru.end();
+	while(shard.bytes + need > budget() && it != shard.lru.begin()){
+		--it;
+		file_data_t* victim = *it;
+		if(freq >= 0 && frequency(shard, victim->value_cache_key) >= freq){
+			return false;
+		}
+		if(!victim->try_uncache()){
+			continue;
+		}
+		it = shard.lru.erase(it);
+		leave(shard, victim);
+	}
+	
+	return shard.bytes + need <= budget();
+}
+
+forest::details::uint_t forest::details::ValueCache::hash(uint_t key, int row)
+{
+	// splitmix64 of the key with the row as seed
+	uint_t x = key + 0x9E3779B97F4A7C15ULL * (row + 1);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
@@ -0,0 +1,71 @@
+#ifndef FOREST_VALUE_CACHE_H
+#define FOREST_VALUE_CACHE_H
+
+#include <list>
+#include <memory>
+#include <vector>
+#include "dbutils.hpp"
+
+namespace forest{
+namespace details{
+	
+	extern int VALUE_CACHE_BYTES;
+	
+	// Cache of leaf values read from files, limited by the global byte
+	// budget. New value is admitted only if it is accessed more often
+	// than the values it would evict (TinyLFU). Frequencies are kept
+	// in the count-min sketch which is halved periodically to forget
+	// old accesses. Values are known by their place on the disk (file or
+	// value log segment and offset), so a leaf read again keeps the
+	// frequencies of its values. Values are spread between shards by that
+	// key and stay in the shard they joined. Every shard has its own lock,
+	// LRU, sketch and part of the budget, so readers of different values
+	// do not wait for each other.
+	class ValueCache{
+		
+		static const int SHARDS = 16;
+		static const int SKETCH_ROWS = 4;
+		static const int SKETCH_WIDTH = 1 << 12;
+		static const int SAMPLE_SIZE = SKETCH_WIDTH * 10;
+		
+		struct alignas(64) shard_t{
+			std::vector<uint8_t> sketch = std::vector<uint8_t>(SKETCH_ROWS * SKETCH_WIDTH, 0);
+			int additions = 0;
+			std::list<file_data_t*> lru;
+			uint_t bytes = 0;
+			mutex mtx;
+		};
+		
+		public:
+			ValueCache();
+			virtual ~ValueCache();
+			void touch(file_data_t* data);
+			bool wants(file_data_t* data);
+			bool admit(file_data_t* data);
+			// Caller must not hold the lock of the value
+			void adopt(file_data_t* data);
+			void forget(file_data_t* data);
+			void clear();
+			uint_t size();
+			
+		private:
+			shard_t& get_shard(uint_t key);
+			void join(int shard, file_data_t* data);
+			static void leave(shard_t& shard, file_data_t* data);
+			static uint_t key(file_data_t* data);
+			static uint_t budget();
+			static int frequency(shard_t& shard, uint_t key);
+			static void increment(shard_t& shard, uint_t key);
+			static void reduce(shard_t& shard);
+			static bool make_room(shard_t& shard, uint_t need, int freq);
+			static uint_t hash(uint_t key, int row);
+			
+			std::unique_ptr<shard_t[]> shards;
+	};
+	
+	extern ValueCache value_cache;
+	
+} // details
+} // forest
+
+#endif // FOREST_VALUE_CACHE_H
@@ -0,0 +1,436 @@
+#include "value_log.hpp"
+#include "value_cache.hpp"
+#include "forest.hpp"
+
+
+forest::details::ValueLog::ValueLog()
+{
+	if(DBFS::exists(VALUE_LOG_FILE)){
+		read_manifest();
+	}
+	
+	// Deltas are written into the manifest, so new ones start from scratch
+	if(DBFS::exists(VALUE_LOG_FILE + "_deltas")){
+		read_deltas();
+		write_manifest();
+	}
+}
+
+forest::details::ValueLog::~ValueLog()
+{
+	collector.wait();
+	
+	std::lock_guard<mutex> lock(mtx);
+	if(segments.size()){
+		write_manifest();
+	}
+}
+
+bool forest::details::ValueLog::fits(tree_t::val_type& data)
+{
+	return VALUE_LOG_THRESHOLD > 0 && data->size() >= (uint_t)VALUE_LOG_THRESHOLD;
+}
+
+bool forest::details::ValueLog::needs_move(tree_t::val_type& data)
+{
+	int_t seg = data->get_segment();
+	if(seg < 0){
+		return fits(data);
+	}
+	
+	std::lock_guard<mutex> lock(mtx);
+	auto it = segments.find(seg);
+	return it == segments.end() || it->second.evacuate;
+}
+
+void forest::details::ValueLog::append(tree_t::val_type& data, char* buf, int buf_size)
+{
+	std::lock_guard<mutex> lock(mtx);
+	
+	if(active < 0 || segments[active].size >= (uint_t)VALUE_LOG_SEGMENT_BYTES){
+		rotate();
+	}
+	
+	segment_t& seg = segments[active];
+	uint_t start = seg.size;
+	
+	{
+		auto reader = data->get_reader();
+		auto f_lock = seg.file->get_lock();
+		seg.file->seekp(start);
+		
+		int rsz;
+		while( (rsz = reader.read(buf, buf_size)) ){
+			seg.file->write(buf, rsz);
+		}
+		seg.file->stream().flush();
+		
+		if(seg.file->fail()){
+			L_ERR("[ValueLog::append]-(cannot write file)");
+			throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+		}
+	}
+	
+	// Appended value counts as referenced until leaf saving finishes
+	seg.size += data->size();
+	seg.live += data->size();
+	
+	data->set_start(start);
+	data->set_file(seg.file);
+	data->set_segment(active);
+	data->set_packed(0);
+	if(data->is_cached()){
+		value_cache.adopt(data.get());
+	}
+}
+
+void forest::details::ValueLog::acquire(refs_t& refs, string tree)
+{
+	std::lock_guard<mutex> lock(mtx);
+	for(auto& ref : refs){
+		segment_t& seg = segments[ref.first];
+		seg.live += ref.second;
+		if(tree.size()){
+			seg.trees.insert(tree);
+		}
+	}
+	
+	// Must be on the disk before leaf file references segments
+	for(auto& ref : refs){
+		record(ref.first);
+	}
+}
+
+void forest::details::ValueLog::release(refs_t& refs)
+{
+	if(refs.empty()){
+		return;
+	}
+	
+	std::lock_guard<mutex> lock(mtx);
+	bool sparse = false;
+	for(auto& ref : refs){
+		auto it = segments.find(ref.first);
+		if(it == segments.end()){
+			continue;
+		}
+		segment_t& seg = it->second;
+		seg.live -= std::min(seg.live, ref.second);
+		if(ref.first != active && seg.live < seg.size * VALUE_LOG_GC_RATIO){
+			sparse = true;
+		}
+	}
+	
+	if(sparse){
+		schedule_collect();
+	}
+}
+
+forest::details::file_ptr forest::details::ValueLog::get_segment(int_t id)
+{
+	std::lock_guard<mutex> lock(mtx);
+	
+	auto it = segments.find(id);
+	if(it == segments.end()){
+		L_ERR("[ValueLog::get_segment]-(segment does not exist)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	
+	if(!it->second.file){
+		it->second.file = file_ptr(new DBFS::File(segment_name(id)));
+	}
+	return it->second.file;
+}
+
+std::pair<forest::details::int_t, forest::details::file_ptr> forest::details::ValueLog::open_stream()
+{
+	// Streamed value gets a segment of its own, since its length is not
+	// known and other values cannot be appended after it meanwhile
+	std::lock_guard<mutex> lock(mtx);
+	int_t id = next_id++;
+	file_ptr file = file_ptr(new DBFS::File(segment_name(id)));
+	if(file->fail()){
+		L_ERR("[ValueLog::open_stream]-(cannot create file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_CREATE_FILE);
+	}
+	
+	segments[id].streaming = true;
+	record(id);
+	return std::make_pair(id, file);
+}
+
+void forest::details::ValueLog::streamed(int_t id, uint_t size)
+{
+	std::lock_guard<mutex> lock(mtx);
+	segments[id].size = size;
+}
+
+void forest::details::ValueLog::close_stream(int_t id)
+{
+	// Writer and values read from it are gone, segment lives while
+	// leafs reference it
+	std::lock_guard<mutex> lock(mtx);
+	auto it = segments.find(id);
+	if(it == segments.end()){
+		return;
+	}
+	it->second.streaming = false;
+	if(!it->second.live){
+		schedule_collect();
+	}
+}
+
+void forest::details::ValueLog::stop()
+{
+	// Sparse segments are not emptied while the forest is folding
+	stopped = true;
+	collector.wait();
+}
+
+void forest::details::ValueLog::rotate()
+{
+	int_t id = next_id++;
+	segment_t& seg = segments[id];
+	seg.file = file_ptr(new DBFS::File(segment_name(id)));
+	if(seg.file->fail()){
+		segments.erase(id);
+		L_ERR("[ValueLog::rotate]-(cannot create file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_CREATE_FILE);
+	}
+	active = id;
+	record(id);
+}
+
+void forest::details::ValueLog::collect()
+{
+	std::unique_lock<mutex> lock(mtx);
+	collecting = false;
+	
+	bool changed = false;
+	std::map<int_t, std::set<string>> moving;
+	for(auto it = segments.begin(); it != segments.end();){
+		if(it->first == active || it->second.streaming){
+			++it;
+			continue;
+		}
+		segment_t& seg = it->second;
+		if(!seg.live){
+			// Values that are still read keep the file opened
+			string name = segment_name(it->first);
+			if(seg.file){
+				seg.file->on_close([](DBFS::File* file){ DBFS::remove(file->name()); });
+			} else {
+				DBFS::remove(name);
+			}
+			it = segments.erase(it);
+			changed = true;
+			continue;
+		}
+		if(seg.live < seg.size * VALUE_LOG_GC_RATIO && !seg.evacuate){
+			// Leafs move such values to the active segment on next save
+			seg.evacuate = true;
+			moving[it->first] = seg.trees;
+		}
+		++it;
+	}
+	
+	if(changed){
+		write_manifest();
+	}
+	lock.unlock();
+	
+	if(moving.size() && !stopped){
+		compact(moving);
+	}
+}
+
+void forest::details::ValueLog::compact(std::map<int_t, std::set<string>>& moving)
+{
+	// Values of sparse segments are written again as they are, so their
+	// leafs are saved soon and the values move to the active segment
+	std::map<string, std::set<int_t>> trees;
+	for(auto& m : moving){
+		for(auto& name : m.second){
+			trees[name].insert(m.first);
+		}
+	}
+	
+	for(auto& t : trees){
+		if(stopped){
+			return;
+		}
+		bool root = t.first == FOREST->get_name();
+		tree_ptr tree;
+		try{
+			tree = root ? FOREST : reach_tree(t.first);
+		} catch(TreeException& e){
+			// Tree was cut, its leafs do not reference anything anymore
+			continue;
+		}
+		
+		try{
+			std::vector<std::pair<tree_t::key_type, tree_t::val_type>> found;
+			for(auto it = tree->get_tree()->begin(); !it.expired(); ++it){
+				if(t.second.count(it->second->get_segment())){
+					found.push_back(std::make_pair(it->first, it->second));
+				}
+			}
+			
+			// Values changed meanwhile are moved by their own save
+			for(auto& f : found){
+				tree->cas(f.first, f.second, f.second);
+			}
+		} catch(TreeException& e){
+			L_ERR("[ValueLog::compact]-(cannot move values)");
+		}
+		if(!root){
+			leave_tree(tree);
+		}
+	}
+}
+
+void forest::details::ValueLog::schedule_collect()
+{
+	if(collecting){
+		return;
+	}
+	collecting = true;
+	collector.work([this]{ collect(); });
+}
+
+void forest::details::ValueLog::read_manifest()
+{
+	DBFS::File* f = new DBFS::File(VALUE_LOG_FILE);
+	
+	int c;
+	f->read(next_id);
+	f->read(active);
+	f->read(c);
+	f->read(generation);
+	bool fail = f->fail();
+	for(int i=0;i<c && !fail;i++){
+		fail = !read_segment(f);
+	}
+	delete f;
+	
+	if(fail){
+		L_ERR("[ValueLog::read_manifest]-(cannot read file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_READ_FILE);
+	}
+	
+	// Continue appending to the new segment
+	active = -1;
+}
+
+void forest::details::ValueLog::read_deltas()
+{
+	DBFS::File* f = new DBFS::File(VALUE_LOG_FILE + "_deltas");
+	
+	// Deltas of the previous manifest are already in it. The last
+	// record may be cut by a crash, so reading stops at the first error
+	uint_t gen;
+	f->read(gen);
+	if(!f->fail() && gen == generation){
+		while(read_segment(f)){}
+	}
+	delete f;
+}
+
+bool forest::details::ValueLog::read_segment(DBFS::File* f)
+{
+	int_t id;
+	int c;
+	segment_t seg;
+	f->read(id);
+	f->read(seg.size);
+	f->read(seg.live);
+	f->read(c);
+	for(int i=0;i<c && !f->fail();i++){
+		uint_t len;
+		f->read(len);
+		f->stream().get();
+		string name(len, '\0');
+		f->read(&name[0], len);
+		seg.trees.insert(name);
+	}
+	if(f->fail()){
+		return false;
+	}
+	
+	segments[id] = seg;
+	next_id = std::max(next_id, id + 1);
+	return true;
+}
+
+void forest::details::ValueLog::write_manifest()
+{
+	DBFS::File* f = DBFS::create();
+	
+	f->write(std::to_string(next_id) + " " + std::to_string(active) + " " + std::to_string(segments.size()) + " " + std::to_string(generation + 1) + "\n");
+	for(auto& it : segments){
+		f->write(segment_line(it.first, it.second));
+	}
+	
+	bool fail = f->fail();
+	string new_name = f->name();
+	delete f;
+	
+	if(fail){
+		L_ERR("[ValueLog::write_manifest]-(cannot write file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	
+	DBFS::remove(VALUE_LOG_FILE);
+	DBFS::move(new_name, VALUE_LOG_FILE);
+	
+	// Deltas of the previous generation are ignored from now on
+	generation++;
+	deltas = nullptr;
+	recorded = 0;
+	if(DBFS::exists(VALUE_LOG_FILE + "_deltas")){
+		DBFS::remove(VALUE_LOG_FILE + "_deltas");
+	}
+}
+
+void forest::details::ValueLog::record(int_t id)
+{
+	// Changed segment is appended to the deltas file, the whole manifest
+	// is written again only once in VALUE_LOG_DELTAS changes
+	if(recorded >= VALUE_LOG_DELTAS){
+		write_manifest();
+		return;
+	}
+	
+	auto it = segments.find(id);
+	if(it == segments.end()){
+		return;
+	}
+	
+	string line = segment_line(id, it->second);
+	if(!deltas){
+		deltas = file_ptr(new DBFS::File(VALUE_LOG_FILE + "_deltas"));
+		line = std::to_string(generation) + "\n" + line;
+	}
+	deltas->write(line);
+	deltas->stream().flush();
+	
+	if(deltas->fail()){
+		L_ERR("[ValueLog::record]-(cannot write file)");
+		throw TreeException(TreeException::ERRORS::CANNOT_WRITE_FILE);
+	}
+	recorded++;
+}
+
+forest::details::string forest::details::ValueLog::segment_line(int_t id, segment_t& seg)
+{
+	string line = std::to_string(id) + " " + std::to_string(seg.size) + " " + std::to_string(seg.live) + " " + std::to_string(seg.trees.size());
+	for(auto& name : seg.trees){
+		line += " " + std::to_string(name.size()) + " " + name;
+	}
+	return line + "\n";
+}
+
+forest::details::string forest::details::ValueLog::segment_name(int_t id)
+{
+	return VALUE_LOG_FILE + "_" + std::to_string(id);
+}
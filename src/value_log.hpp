@@ -0,0 +1,74 @@
+#ifndef FOREST_VALUE_LOG_H
+#define FOREST_VALUE_LOG_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include "dbutils.hpp"
+#include "variables.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Append only segments for large values. Leafs keep only
+	// (segment, offset) pointers, so leaf rewrites skip the value bytes.
+	// Every leaf file accounts bytes it references in each segment,
+	// segment is removed when no leaf file references it anymore.
+	// Sparse segments are emptied in background by changing the leafs
+	// which reference them, so their next save moves the values.
+	class ValueLog{
+		
+		struct segment_t{
+			file_ptr file;
+			uint_t size = 0;
+			uint_t live = 0;
+			bool evacuate = false;
+			bool streaming = false;
+			std::set<string> trees;
+		};
+		
+		public:
+			using refs_t = std::vector<std::pair<int_t, uint_t>>;
+			
+			ValueLog();
+			virtual ~ValueLog();
+			bool fits(tree_t::val_type& data);
+			bool needs_move(tree_t::val_type& data);
+			void append(tree_t::val_type& data, char* buf, int buf_size);
+			void acquire(refs_t& refs, string tree);
+			void release(refs_t& refs);
+			file_ptr get_segment(int_t id);
+			void stop();
+			std::pair<int_t, file_ptr> open_stream();
+			void streamed(int_t id, uint_t size);
+			void close_stream(int_t id);
+			
+		private:
+			void rotate();
+			void collect();
+			void compact(std::map<int_t, std::set<string>>& moving);
+			void schedule_collect();
+			void read_manifest();
+			void read_deltas();
+			bool read_segment(DBFS::File* f);
+			void write_manifest();
+			void record(int_t id);
+			string segment_line(int_t id, segment_t& seg);
+			string segment_name(int_t id);
+			
+			std::map<int_t, segment_t> segments;
+			int_t active = -1;
+			int_t next_id = 0;
+			uint_t generation = 0;
+			file_ptr deltas;
+			int recorded = 0;
+			bool collecting = false;
+			std::atomic<bool> stopped = false;
+			mutex mtx;
+			Thread_worker collector{Thread_pool::PRIORITY::COMPACTION};
+	};
+	
+} // details
+} // forest
+
+#endif // FOREST_VALUE_LOG_H
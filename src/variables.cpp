@@ -4,6 +4,29 @@ namespace forest{
 namespace details{
 	
 	const string LEAF_NULL = "-";
+	const size_t FIND_BUNCH_MIN = 256;
+	const int LEAF_BUFFER_BYTES = 64 * 1024;
+	const int LEAF_FLAG_PACKED_KEYS = 1;
+	const int LEAF_FLAG_PACKED_VALUES = 2;
+	const int LEAF_FLAG_CHECKSUM = 4;
+	const int LEAF_FLAG_VALUE_CHECKSUMS = 8;
+	const double VALUE_LOG_GC_RATIO = 0.5;
+	const string VALUE_LOG_FILE = "_vlog";
+	const int VALUE_LOG_DELTAS = 1024;
+	const int DICT_SAMPLES = 2048;
+	const int DICT_REBUILD_BYTES = 1024 * 1024;
+	const int DICT_REBUILD_VALUES = 256;
+	const double DICT_REBUILD_RATIO = 0.75;
+	const string DICT_FILE = "_dict_";
+	const string JOURNAL_FILE = "_journal";
+	const int JOURNAL_BYTES = 1024 * 1024;
+	const string WARM_FILE = "_warm";
+	const string TRANSACTION_LOG_FILE = "_transactions";
+	const int TRANSACTION_LOG_BYTES = 4 * 1024 * 1024;
+	const int MERGE_CHAIN_LENGTH = 64;
+	const int THREAD_POOL_MIN = 8;
+	const int IO_OP_BYTES = 64 * 1024;
+	const int WRITE_STALL_MKS = 1000;
 
 	string ROOT_TREE = "_root";
 	int ROOT_FACTOR = 100;
@@ -11,11 +34,29 @@ namespace details{
 	int INTR_CACHE_LENGTH = 20;
 	int LEAF_CACHE_LENGTH = 50;
 	int TREE_CACHE_LENGTH = 10;
-	int CACHE_BYTES = 128;
+	int CACHE_BYTES = 65536;
+	int VALUE_CACHE_BYTES = 32 * 1024 * 1024;
 	int CHUNK_SIZE = 512;
 	int OPENED_FILES_LIMIT = 50;
 	int SCHEDULE_TIMER = 10000;
 	int SAVIOUR_QUEUE_LENGTH = 50;
+	int SAVIOUR_FLUSH_LIMIT = 32;
+	int SAVE_HIGH_ITEMS = 100000;
+	int SAVE_LOW_ITEMS = 50000;
+	int SAVE_HIGH_BYTES = 512 * 1024 * 1024;
+	int SAVE_LOW_BYTES = 256 * 1024 * 1024;
+	bool SAVE_REJECT_STALLED = false;
+	int VALUE_LOG_THRESHOLD = 0;
+	int VALUE_LOG_SEGMENT_BYTES = 64 * 1024 * 1024;
+	int COMPRESSION_LEVEL = 3;
+	int COMPRESS_VALUE_BYTES = 1024;
+	int DICT_BYTES = 16 * 1024;
+	int DICT_VALUE_BYTES = 64;
+	bool VALUE_CHECKSUMS = false;
+	bool WARM_CACHE = false;
+	int THREAD_POOL_SIZE = 0;
+	int IO_WRITE_SHARE = 20;
+	int IO_WRITE_DEADLINE_MKS = 100000;
 	
 } // details
 } // forest
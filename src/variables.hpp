@@ -20,9 +20,45 @@ namespace details{
 	extern int LOGGER_FLAG;
 	extern int LOG_DETAILS;
 	extern int CACHE_BYTES;
+	extern int VALUE_CACHE_BYTES;
 	extern int CHUNK_SIZE;
 	extern int OPENED_FILES_LIMIT;
 	extern int SAVIOUR_QUEUE_LENGTH;
+	extern int SAVIOUR_FLUSH_LIMIT;
+	extern const size_t FIND_BUNCH_MIN;
+	extern const int LEAF_BUFFER_BYTES;
+	extern const int LEAF_FLAG_PACKED_KEYS;
+	extern const int LEAF_FLAG_PACKED_VALUES;
+	extern const int LEAF_FLAG_CHECKSUM;
+	extern const int LEAF_FLAG_VALUE_CHECKSUMS;
+	extern bool VALUE_CHECKSUMS;
+	extern int COMPRESSION_LEVEL;
+	extern int COMPRESS_VALUE_BYTES;
+	extern int DICT_BYTES;
+	extern int DICT_VALUE_BYTES;
+	extern const int DICT_SAMPLES;
+	extern const int DICT_REBUILD_BYTES;
+	extern const int DICT_REBUILD_VALUES;
+	extern const double DICT_REBUILD_RATIO;
+	extern const string DICT_FILE;
+	extern int VALUE_LOG_THRESHOLD;
+	extern int VALUE_LOG_SEGMENT_BYTES;
+	extern const double VALUE_LOG_GC_RATIO;
+	extern const string VALUE_LOG_FILE;
+	extern const int VALUE_LOG_DELTAS;
+	extern const string JOURNAL_FILE;
+	extern const int JOURNAL_BYTES;
+	extern const string WARM_FILE;
+	extern const string TRANSACTION_LOG_FILE;
+	extern const int TRANSACTION_LOG_BYTES;
+	extern const int MERGE_CHAIN_LENGTH;
+	extern bool WARM_CACHE;
+	extern int THREAD_POOL_SIZE;
+	extern const int THREAD_POOL_MIN;
+	extern int IO_WRITE_SHARE;
+	extern int IO_WRITE_DEADLINE_MKS;
+	extern const int IO_OP_BYTES;
+	extern const int WRITE_STALL_MKS;
 	
 } // details
 } // forest
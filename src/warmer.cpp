@@ -0,0 +1,199 @@
+#include "warmer.hpp"
+#include "forest.hpp"
+
+
+forest::details::Warmer::Warmer()
+{
+	// ctor
+}
+
+forest::details::Warmer::~Warmer()
+{
+	stop();
+}
+
+void forest::details::Warmer::save()
+{
+	std::vector<tree_ptr> trees = cache::get_hot_trees();
+	trees.push_back(FOREST);
+	
+	std::vector<entry_t> entries(trees.size());
+	for(size_t i=0;i<trees.size();i++){
+		entries[i].tree = trees[i]->get_name();
+	}
+	
+	// Internal nodes go first as they are shared by more paths
+	for(auto type : {NODE_TYPES::INTR, NODE_TYPES::LEAF}){
+		for(auto& node : cache::get_hot_nodes(type)){
+			tree_t::key_type key;
+			if(!first_key(node, key)){
+				continue;
+			}
+			for(size_t i=0;i<trees.size();i++){
+				if(trees[i]->owns(node)){
+					entries[i].keys.push_back(key);
+					break;
+				}
+			}
+		}
+	}
+	
+	DBFS::File* f = DBFS::create();
+	f->write(std::to_string(entries.size()) + "\n");
+	for(auto& entry : entries){
+		// Tree names may contain spaces, so they are sized like keys
+		f->write(std::to_string(entry.tree.size()) + " " + entry.tree + " " + std::to_string(entry.keys.size()) + "\n");
+		for(auto& key : entry.keys){
+			f->write(std::to_string(key.size()) + " " + key + "\n");
+		}
+	}
+	
+	bool fail = f->fail();
+	string new_name = f->name();
+	delete f;
+	
+	if(fail){
+		// Manifest is only a hint, folding goes on without it
+		L_ERR("[Warmer::save]-(cannot write file)");
+		DBFS::remove(new_name);
+		return;
+	}
+	
+	DBFS::remove(WARM_FILE);
+	DBFS::move(new_name, WARM_FILE);
+}
+
+void forest::details::Warmer::warm()
+{
+	if(!DBFS::exists(WARM_FILE)){
+		return;
+	}
+	
+	stopped = false;
+	warming = true;
+	
+	worker.work([this]{
+		std::vector<entry_t> entries = read_manifest();
+		
+		std::atomic<size_t> next = 0;
+		auto reader = [this, &entries, &next]{
+			size_t i;
+			while(!stopped && (i = next++) < entries.size()){
+				warm_tree(entries[i]);
+			}
+		};
+		
+		// Paths are read in parallel, requests are served meanwhile
+		size_t threads_count = std::min(entries.size(), (std::size_t)thread_pool->size());
+		thread_pool->parallel(Thread_pool::PRIORITY::PREFETCH, threads_count, reader);
+		
+		warming = false;
+	});
+}
+
+void forest::details::Warmer::stop()
+{
+	stopped = true;
+	worker.wait();
+}
+
+bool forest::details::Warmer::is_warming()
+{
+	return warming;
+}
+
+std::vector<forest::details::Warmer::entry_t> forest::details::Warmer::read_manifest()
+{
+	std::vector<entry_t> entries;
+	
+	DBFS::File* f = new DBFS::File(WARM_FILE);
+	std::istream& in = f->stream();
+	
+	size_t c = 0;
+	in >> c;
+	for(size_t i=0;i<c && in;i++){
+		entry_t entry;
+		size_t name_sz = 0, keys = 0;
+		in >> name_sz;
+		in.get();
+		entry.tree = string(name_sz, '\0');
+		in.read(&entry.tree[0], name_sz);
+		in >> keys;
+		for(size_t j=0;j<keys && in;j++){
+			size_t sz = 0;
+			in >> sz;
+			in.get();
+			tree_t::key_type key(sz, '\0');
+			in.read(&key[0], sz);
+			entry.keys.push_back(key);
+			
+			// Paths of a large tree are split between readers too
+			if(entry.keys.size() == WARM_BATCH_KEYS){
+				entries.push_back(entry);
+				entry.keys.clear();
+			}
+		}
+		if(entry.keys.size()){
+			entries.push_back(entry);
+		}
+	}
+	
+	if(in.fail()){
+		// Stale manifest just warms less
+		L_ERR("[Warmer::read_manifest]-(cannot read file)");
+	}
+	delete f;
+	
+	return entries;
+}
+
+void forest::details::Warmer::warm_tree(entry_t& entry)
+{
+	bool root = entry.tree == FOREST->get_name();
+	tree_ptr tree;
+	
+	try{
+		tree = root ? FOREST : reach_tree(entry.tree);
+	} catch(TreeException& e){
+		// Tree was cut after the manifest was written
+		return;
+	}
+	
+	for(auto& key : entry.keys){
+		if(stopped){
+			break;
+		}
+		// Lookup loads every node on the path into the cache. Separators
+		// and tree names may outlive their keys, so the key is not required
+		try{
+			tree_t::iterator it = tree->get_tree()->lower_bound(key);
+		} catch(TreeException& e){
+			L_ERR("[Warmer::warm_tree]-(cannot read node)");
+			break;
+		}
+	}
+	
+	if(!root){
+		leave_tree(tree);
+	}
+}
+
+bool forest::details::Warmer::first_key(tree_t::node_ptr node, tree_t::key_type& key)
+{
+	// Forest is folding, so cached nodes are not changed anymore
+	if(node->is_leaf()){
+		auto* childs = node->get_childs();
+		if(!childs || childs->begin() == childs->end()){
+			return false;
+		}
+		key = childs->begin()->data->item->first;
+		return true;
+	}
+	
+	auto start = node->keys_iterator();
+	if(start == node->keys_iterator_end()){
+		return false;
+	}
+	key = *start;
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifndef FOREST_WARMER_H
+#define FOREST_WARMER_H
+
+#include <vector>
+#include "dbutils.hpp"
+#include "variables.hpp"
+#include "cache.hpp"
+#include "tree.hpp"
+
+namespace forest{
+namespace details{
+	
+	// Nodes cached at fold are written to the manifest as the first key
+	// of each node, so the next bloom could load the same paths in
+	// background while requests are already served.
+	class Warmer{
+		
+		struct entry_t{
+			string tree;
+			std::vector<tree_t::key_type> keys;
+		};
+		
+		static const size_t WARM_BATCH_KEYS = 8;
+		
+		public:
+			Warmer();
+			virtual ~Warmer();
+			void save();
+			void warm();
+			void stop();
+			bool is_warming();
+		
+		private:
+			std::vector<entry_t> read_manifest();
+			void warm_tree(entry_t& entry);
+			static bool first_key(tree_t::node_ptr node, tree_t::key_type& key);
+			
+			std::atomic<bool> stopped = false;
+			std::atomic<bool> warming = false;
+			Thread_worker worker{Thread_pool::PRIORITY::PREFETCH, true};
+	};
+	
+	extern Warmer* warmer;
+
+} // details
+} // forest
+
+#endif // FOREST_WARMER_H
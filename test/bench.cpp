@@ -0,0 +1,379 @@
+#include "forest.hpp"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <filesystem>
+using namespace std;
+
+// YCSB style workloads:
+// A -- 50% reads, 50% updates
+// B -- 95% reads, 5% updates
+// C -- 100% reads
+// D -- 95% reads, 5% inserts, latest keys are read the most
+// E -- 95% short scans, 5% inserts
+// F -- 50% reads, 50% read-modify-writes
+
+enum class OP{ READ, UPDATE, INSERT, SCAN, RMW };
+const int OPS = 5;
+const char* op_names[] = {"read", "update", "insert", "scan", "rmw"};
+
+struct workload_t{
+	string name;
+	double read, update, insert, scan, rmw;
+	string distribution;
+};
+
+struct config_t{
+	string workloads = "ABCDEF";
+	string distribution = "";
+	string path = "tmp/bench";
+	vector<int> threads = {1, 2, 4, 8};
+	long long records = 100000;
+	long long operations = 100000;
+	int value_bytes = 100;
+	int scan_length = 100;
+	int cache_bytes = 0;
+	int leaf_cache = 0;
+	int value_cache_bytes = -1;
+	unsigned long long seed = 1;
+};
+
+// Zipfian generator from "Quickly Generating Billion-Record Synthetic
+// Databases" by Gray et al., the same as YCSB uses
+class zipfian{
+	public:
+		zipfian(unsigned long long items, double theta = 0.99) : items(items), theta(theta)
+		{
+			double zeta2 = zeta(2);
+			zetan = zeta(items);
+			alpha = 1 / (1 - theta);
+			eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetan);
+			half = 1 + pow(0.5, theta);
+		}
+		
+		unsigned long long next(mt19937_64& rng)
+		{
+			double u = uniform_real_distribution<double>(0, 1)(rng);
+			double uz = u * zetan;
+			if(uz < 1){
+				return 0;
+			}
+			if(uz < half){
+				return 1;
+			}
+			return min(items - 1, (unsigned long long)(items * pow(eta * u - eta + 1, alpha)));
+		}
+	
+	private:
+		double zeta(unsigned long long n)
+		{
+			double sum = 0;
+			for(unsigned long long i=1;i<=n;i++){
+				sum += 1 / pow(i, theta);
+			}
+			return sum;
+		}
+		
+		unsigned long long items;
+		double theta, zetan, alpha, eta, half;
+};
+
+unsigned long long fnv64(unsigned long long v)
+{
+	unsigned long long h = 0xCBF29CE484222325ULL;
+	for(int i=0;i<8;i++){
+		h ^= v & 0xFF;
+		h *= 1099511628211ULL;
+		v >>= 8;
+	}
+	return h;
+}
+
+// Keys are hashed, so inserted keys are spread over the whole tree
+string make_key(unsigned long long n)
+{
+	return "user" + to_string(fnv64(n));
+}
+
+string make_value(int bytes, mt19937_64& rng)
+{
+	string v(bytes, ' ');
+	for(auto& c : v){
+		c = 'a' + rng() % 26;
+	}
+	return v;
+}
+
+void read_value(forest::DetachedLeaf leaf)
+{
+	static thread_local char buf[4096];
+	auto reader = leaf->get_reader();
+	while(reader.read(buf, sizeof(buf)));
+}
+
+string histogram_json(forest::Histogram h)
+{
+	// Latencies are recorded in nanoseconds and reported in microseconds
+	ostringstream out;
+	out << "{\"count\":" << h.count
+		<< ",\"p50\":" << h.p50 / 1000.0
+		<< ",\"p99\":" << h.p99 / 1000.0
+		<< ",\"p999\":" << h.p999 / 1000.0
+		<< ",\"max\":" << h.max / 1000.0 << "}";
+	return out.str();
+}
+
+class bench{
+	public:
+		bench(config_t& config, workload_t& workload, int threads) : config(config), workload(workload), threads(threads), zipf(config.records)
+		{
+			// ctor
+		}
+		
+		string run()
+		{
+			string path = config.path + "/" + workload.name + "_" + to_string(threads);
+			filesystem::remove_all(path);
+			filesystem::create_directories(path);
+			forest::bloom(path);
+			forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "usertable");
+			tree = forest::find_tree("usertable");
+			
+			double load_seconds = measure([this](int t){ load(t); });
+			inserted = config.records;
+			double seconds = measure([this](int t){ work(t); });
+			
+			tree = nullptr;
+			forest::fold();
+			
+			ostringstream out;
+			out << "{\"workload\":\"" << workload.name << "\""
+				<< ",\"distribution\":\"" << distribution() << "\""
+				<< ",\"threads\":" << threads
+				<< ",\"load_seconds\":" << load_seconds
+				<< ",\"load_throughput\":" << config.records / load_seconds
+				<< ",\"operations\":" << config.operations
+				<< ",\"seconds\":" << seconds
+				<< ",\"throughput\":" << config.operations / seconds
+				<< ",\"not_found\":" << not_found
+				<< ",\"latency_us\":{";
+			bool first = true;
+			for(int i=0;i<OPS;i++){
+				forest::Histogram h = latencies[i].snapshot();
+				if(!h.count){
+					continue;
+				}
+				out << (first ? "" : ",") << "\"" << op_names[i] << "\":" << histogram_json(h);
+				first = false;
+			}
+			out << "}}";
+			return out.str();
+		}
+	
+	private:
+		string distribution()
+		{
+			if(config.distribution.size()){
+				return config.distribution;
+			}
+			return workload.distribution;
+		}
+		
+		double measure(function<void(int)> fn)
+		{
+			auto start = chrono::steady_clock::now();
+			vector<thread> pool;
+			for(int t=0;t<threads;t++){
+				pool.push_back(thread(fn, t));
+			}
+			for(auto& t : pool){
+				t.join();
+			}
+			return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+		
+		void load(int t)
+		{
+			mt19937_64 rng(config.seed * 1000 + t);
+			for(long long i=t;i<config.records;i+=threads){
+				forest::insert_leaf(tree, make_key(i), forest::make_leaf(make_value(config.value_bytes, rng)));
+			}
+		}
+		
+		void work(int t)
+		{
+			mt19937_64 rng(config.seed * 1000 + threads * 100 + t);
+			uniform_real_distribution<double> pick(0, 1);
+			long long count = config.operations / threads + (t < config.operations % threads);
+			
+			for(long long i=0;i<count;i++){
+				double p = pick(rng);
+				OP op = p < workload.read ? OP::READ
+					: (p -= workload.read) < workload.update ? OP::UPDATE
+					: (p -= workload.update) < workload.insert ? OP::INSERT
+					: (p -= workload.insert) < workload.scan ? OP::SCAN
+					: OP::RMW;
+				
+				auto start = chrono::steady_clock::now();
+				try{
+					run_op(op, next_key(rng), rng);
+				} catch(forest::TreeException& e){
+					++not_found;
+				}
+				latencies[(int)op].record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+			}
+		}
+		
+		void run_op(OP op, unsigned long long n, mt19937_64& rng)
+		{
+			switch(op){
+				case OP::READ:
+					read_value(forest::find_leaf(tree, make_key(n))->val());
+					break;
+				case OP::UPDATE:
+					forest::update_leaf(tree, make_key(n), forest::make_leaf(make_value(config.value_bytes, rng)));
+					break;
+				case OP::INSERT:
+					forest::insert_leaf(tree, make_key(inserted++), forest::make_leaf(make_value(config.value_bytes, rng)));
+					break;
+				case OP::SCAN: {
+					int length = 1 + rng() % config.scan_length;
+					auto leaf = forest::find_leaf(tree, make_key(n), forest::LEAF_POSITION::LOWER);
+					for(int i=0;i<length && !leaf->eof();i++){
+						read_value(leaf->val());
+						leaf->move_forward();
+					}
+					break;
+				}
+				case OP::RMW:
+					read_value(forest::find_leaf(tree, make_key(n))->val());
+					forest::update_leaf(tree, make_key(n), forest::make_leaf(make_value(config.value_bytes, rng)));
+					break;
+			}
+		}
+		
+		unsigned long long next_key(mt19937_64& rng)
+		{
+			string d = distribution();
+			unsigned long long count = inserted;
+			if(d == "uniform"){
+				return rng() % config.records;
+			}
+			if(d == "latest"){
+				// Recently inserted keys are the hottest
+				unsigned long long back = zipf.next(rng);
+				return back < count ? count - 1 - back : 0;
+			}
+			// Popular keys are scattered over the key space
+			return fnv64(zipf.next(rng)) % config.records;
+		}
+		
+		config_t& config;
+		workload_t& workload;
+		int threads;
+		zipfian zipf;
+		forest::Tree tree;
+		atomic<unsigned long long> inserted = 0;
+		atomic<long long> not_found = 0;
+		forest::details::histogram latencies[OPS];
+};
+
+vector<int> parse_list(string s)
+{
+	vector<int> res;
+	stringstream ss(s);
+	string item;
+	while(getline(ss, item, ',')){
+		res.push_back(stoi(item));
+	}
+	return res;
+}
+
+void usage()
+{
+	cerr << "Usage: bench.exe [options]\n"
+		<< "  --workloads ABCDEF      workloads to run\n"
+		<< "  --distribution NAME     zipfian, uniform or latest (default per workload)\n"
+		<< "  --threads 1,2,4,8       thread counts to sweep\n"
+		<< "  --records N             records loaded before the run\n"
+		<< "  --operations N          operations per run\n"
+		<< "  --value-bytes N         size of the values\n"
+		<< "  --scan-length N         longest scan of workload E\n"
+		<< "  --cache-bytes N         forest::config_cache_bytes\n"
+		<< "  --leaf-cache N          forest::config_leaf_cache_length\n"
+		<< "  --value-cache-bytes N   forest::config_value_cache_bytes\n"
+		<< "  --path PATH             directory for the data\n"
+		<< "  --seed N                seed of the generators\n";
+}
+
+int main(int argc, char** argv)
+{
+	config_t config;
+	for(int i=1;i<argc;i++){
+		string arg = argv[i];
+		if(i + 1 >= argc){
+			usage();
+			return 1;
+		}
+		string val = argv[++i];
+		if(arg == "--workloads") config.workloads = val;
+		else if(arg == "--distribution") config.distribution = val;
+		else if(arg == "--threads") config.threads = parse_list(val);
+		else if(arg == "--records") config.records = stoll(val);
+		else if(arg == "--operations") config.operations = stoll(val);
+		else if(arg == "--value-bytes") config.value_bytes = stoi(val);
+		else if(arg == "--scan-length") config.scan_length = stoi(val);
+		else if(arg == "--cache-bytes") config.cache_bytes = stoi(val);
+		else if(arg == "--leaf-cache") config.leaf_cache = stoi(val);
+		else if(arg == "--value-cache-bytes") config.value_cache_bytes = stoi(val);
+		else if(arg == "--path") config.path = val;
+		else if(arg == "--seed") config.seed = stoull(val);
+		else {
+			usage();
+			return 1;
+		}
+	}
+	
+	if(config.cache_bytes > 0){
+		forest::config_cache_bytes(config.cache_bytes);
+	}
+	if(config.leaf_cache > 0){
+		forest::config_leaf_cache_length(config.leaf_cache);
+	}
+	if(config.value_cache_bytes >= 0){
+		forest::config_value_cache_bytes(config.value_cache_bytes);
+	}
+	
+	vector<workload_t> workloads = {
+		{"A", 0.5, 0.5, 0, 0, 0, "zipfian"},
+		{"B", 0.95, 0.05, 0, 0, 0, "zipfian"},
+		{"C", 1, 0, 0, 0, 0, "zipfian"},
+		{"D", 0.95, 0, 0.05, 0, 0, "latest"},
+		{"E", 0, 0, 0.05, 0.95, 0, "zipfian"},
+		{"F", 0.5, 0, 0, 0, 0.5, "zipfian"}
+	};
+	
+	cout << "{\"records\":" << config.records
+		<< ",\"operations\":" << config.operations
+		<< ",\"value_bytes\":" << config.value_bytes
+		<< ",\"seed\":" << config.seed
+		<< ",\"results\":[";
+	bool first = true;
+	for(auto& w : workloads){
+		if(config.workloads.find(w.name) == string::npos){
+			continue;
+		}
+		for(int threads : config.threads){
+			bench b(config, w, threads);
+			cout << (first ? "" : ",") << "\n" << b.run() << flush;
+			first = false;
+		}
+	}
+	cout << "\n]}" << endl;
+	
+	return 0;
+}
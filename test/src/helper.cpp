@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <sys/stat.h>
 #include <string>
+#include <fstream>
+#include <sstream>
 
 int dir_count(std::string path)
 {
@@ -23,6 +26,28 @@ int dir_count(std::string path)
 	return i-2;
 }
 
+long long dir_bytes(std::string path)
+{
+	DIR *dp;
+	long long sz = 0;
+	struct dirent *ep;
+	struct stat st;
+	dp = opendir (path.c_str());
+
+	if (dp != NULL)
+	{
+		while ( (ep = readdir (dp)) )
+			if (stat((path + "/" + ep->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+				sz += st.st_size;
+
+		(void) closedir (dp);
+	}
+	else
+		perror ("Couldn't open the directory");
+
+	return sz;
+}
+
 string to_str(int a)
 {
 	string ret;
@@ -75,3 +100,36 @@ string read_leaf(forest::DetachedLeaf item)
 	delete[] buf;
 	return ret;
 }
+
+string json_value(int a, int items)
+{
+	string ret = "{\"id\":" + std::to_string(a) + ",\"items\":[";
+	for(int i=0;i<items;i++){
+		if(i){
+			ret.push_back(',');
+		}
+		ret.append("{\"name\":\"item_" + std::to_string(i) + "\",\"price\":" + std::to_string((a*31+i*7)%1000) + ",\"tags\":[\"red\",\"large\"]}");
+	}
+	ret.append("]}");
+	return ret;
+}
+
+string read_file(std::string path)
+{
+	std::ifstream in(path, std::ios::binary);
+	std::stringstream ss;
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+void write_file(std::string path, std::string data)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out << data;
+}
+
+bool file_exists(std::string path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
@@ -151,6 +151,36 @@ DESCRIBE("Test multi threads", {
 			});
 		});
 		
+		DESCRIBE("Add `counters` tree", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "counters", 3);
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("counters");
+			});
+			
+			IT("Increment 5 counters in 50 threads with merge_leaf", {
+				vector<thread> trds;
+				for(int i=0;i<50;i++){
+					trds.push_back(thread([](int ind){
+						for(int j=0;j<20;j++){
+							forest::merge_leaf("counters", "c"+to_string((ind+j)%5), [](forest::DetachedLeaf cur){
+								int count = cur ? stoi(read_leaf(cur)) : 0;
+								return forest::make_leaf(to_string(count + 1));
+							});
+						}
+					}, i));
+				}
+				for(auto& it : trds){
+					it.join();
+				}
+				for(int i=0;i<5;i++){
+					EXPECT(read_leaf(forest::find_leaf("counters", "c"+to_string(i))->val())).toBe("200");
+				}
+			});
+		});
+		
 		// Leaf insertions
 		DESCRIBE("Add `test` tree to the forest", {
 			BEFORE_EACH({
@@ -326,5 +326,79 @@ DESCRIBE("Initialize forest at tmp/perf", {
 				forest::fold();
 			});
 		});
+		
+		DESCRIBE("Single Thread Compressed Data Pool", {
+			int rec_count = 20000;
+			long long bytes_plain, bytes_packed;
+			
+			BEFORE_ALL({
+				config_high();
+				forest::bloom("tmp/t3");
+				
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "plain", 500);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "packed", 500, "", forest::COMPRESSION_TYPES::ZSTD);
+			});
+			
+			IT("Insert 20000 JSON items into plain tree", {
+				p1 = chrono::system_clock::now();
+				forest::Tree tree = forest::find_tree("plain");
+				for(int i=0;i<rec_count;i++){
+					forest::insert_leaf(tree, to_str(i), forest::make_leaf(json_value(i, 20)));
+				}
+				forest::fold();
+				p2 = chrono::system_clock::now();
+				bytes_plain = dir_bytes("tmp/t3");
+				forest::bloom("tmp/t3");
+				time_free = chrono::duration_cast<chrono::milliseconds>(p2-p1).count();
+				TEST_SUCCEED();
+				INFO_PRINT("Time For Insert: " + to_string(time_free) + "ms, Bytes: " + std::to_string(bytes_plain));
+			});
+			
+			IT("Insert 20000 JSON items into packed tree", {
+				p1 = chrono::system_clock::now();
+				forest::Tree tree = forest::find_tree("packed");
+				for(int i=0;i<rec_count;i++){
+					forest::insert_leaf(tree, to_str(i), forest::make_leaf(json_value(i, 20)));
+				}
+				forest::fold();
+				p2 = chrono::system_clock::now();
+				bytes_packed = dir_bytes("tmp/t3") - bytes_plain;
+				forest::bloom("tmp/t3");
+				time_free = chrono::duration_cast<chrono::milliseconds>(p2-p1).count();
+				TEST_SUCCEED();
+				INFO_PRINT("Time For Insert: " + to_string(time_free) + "ms, Bytes: " + std::to_string(bytes_packed));
+			});
+			
+			IT("Get all items of plain tree", {
+				p1 = chrono::system_clock::now();
+				forest::Tree t = forest::find_tree("plain");
+				for(int i=0;i<rec_count;i++){
+					EXPECT(read_leaf(forest::find_leaf(t, to_str(i))->val())).toBe(json_value(i, 20));
+				}
+				p2 = chrono::system_clock::now();
+				time_free = chrono::duration_cast<chrono::milliseconds>(p2-p1).count();
+				TEST_SUCCEED();
+				INFO_PRINT("Time For Find: " + to_string(time_free) + "ms");
+			});
+			
+			IT("Get all items of packed tree", {
+				p1 = chrono::system_clock::now();
+				forest::Tree t = forest::find_tree("packed");
+				for(int i=0;i<rec_count;i++){
+					EXPECT(read_leaf(forest::find_leaf(t, to_str(i))->val())).toBe(json_value(i, 20));
+				}
+				p2 = chrono::system_clock::now();
+				time_free = chrono::duration_cast<chrono::milliseconds>(p2-p1).count();
+				TEST_SUCCEED();
+				INFO_PRINT("Time For Find: " + to_string(time_free) + "ms");
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("plain");
+				forest::cut_tree("packed");
+				
+				forest::fold();
+			});
+		});
 	});
 });
@@ -240,6 +240,942 @@ DESCRIBE("Test single thread", {
 			});
 		});
 		
+		DESCRIBE("Add `stats` tree with 200 items", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "stats", 3);
+				for(int i=0;i<200;i++){
+					forest::insert_leaf("stats", "s"+std::to_string(i), forest::make_leaf("1234567890"));
+				}
+				for(int i=0;i<50;i++){
+					forest::remove_leaf("stats", "s"+std::to_string(i));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("stats");
+			});
+			
+			IT("tree stats should count items and bytes", {
+				forest::TreeStats stats = forest::tree_stats(forest::find_tree("stats"));
+				EXPECT(stats.count).toBe(150);
+				EXPECT(stats.bytes).toBe(1500);
+				EXPECT(stats.leafs > 1).toBe(true);
+				EXPECT(stats.depth > 1).toBe(true);
+			});
+			
+			IT("tree depth should not be changed by moving through the leafs", {
+				int depth = forest::tree_stats(forest::find_tree("stats")).depth;
+				auto it = forest::find_leaf("stats", "s100");
+				while(it->move_forward());
+				EXPECT(forest::tree_stats(forest::find_tree("stats")).depth).toBe(depth);
+			});
+		});
+		
+		DESCRIBE("Add `bunch` tree with 300 items", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "bunch", 5);
+				for(int i=0;i<300;i++){
+					forest::insert_leaf("bunch", "b"+std::to_string(i*2), forest::make_leaf("val_" + std::to_string(i*2)));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("bunch");
+			});
+			
+			IT("find_leaves should return leafs in request order", {
+				vector<string> keys;
+				for(int i=0;i<600;i++){
+					keys.push_back("b"+std::to_string(rand()%600));
+				}
+				auto leafs = forest::find_leaves("bunch", keys);
+				EXPECT(leafs.size()).toBe(keys.size());
+				for(size_t i=0;i<keys.size();i++){
+					int num = std::stoi(keys[i].substr(1));
+					if(num%2){
+						EXPECT(leafs[i]->eof()).toBe(true);
+					} else {
+						EXPECT(leafs[i]->key()).toBe(keys[i]);
+						EXPECT(read_leaf(leafs[i]->val())).toBe("val_" + std::to_string(num));
+					}
+				}
+			});
+		});
+		
+		DESCRIBE("Add `stream` tree with streamed leaf", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "stream");
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("stream");
+			});
+			
+			IT("streamed value should be equal to written chunks", {
+				forest::LeafWriter writer = forest::make_leaf_writer();
+				string expected = "";
+				for(int i=0;i<100;i++){
+					string chunk = "chunk_" + std::to_string(i) + ";";
+					writer->write(chunk);
+					expected += chunk;
+				}
+				EXPECT(writer->size()).toBe(expected.size());
+				forest::insert_leaf("stream", "s", writer->finish());
+				EXPECT(read_leaf(forest::find_leaf("stream", "s")->val())).toBe(expected);
+			});
+			
+			IT("finished writer should not accept more data", {
+				forest::LeafWriter writer = forest::make_leaf_writer();
+				writer->write("data");
+				writer->finish();
+				EXPECT([&writer](){ writer->write("more"); }).toThrowError();
+			});
+		});
+		
+		DESCRIBE("Add `vlog` tree with values in the value log", {
+			BEFORE_ALL({
+				forest::config_value_log_threshold(64);
+				forest::config_value_log_segment_bytes(4096);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "vlog", 5);
+				for(int i=0;i<200;i++){
+					forest::insert_leaf("vlog", "v"+std::to_string(1000+i), forest::make_leaf(string(i%2 ? 100 : 10, 'a' + i%26)));
+				}
+				for(int i=0;i<200;i+=4){
+					forest::update_leaf("vlog", "v"+std::to_string(1000+i), forest::make_leaf(string(120, 'z')));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("vlog");
+				forest::config_value_log_threshold(0);
+			});
+			
+			IT("values should be read back from both leafs and the value log", {
+				for(int i=0;i<200;i++){
+					string expected = (i%4 == 0) ? string(120, 'z') : string(i%2 ? 100 : 10, 'a' + i%26);
+					EXPECT(read_leaf(forest::find_leaf("vlog", "v"+std::to_string(1000+i))->val())).toBe(expected);
+				}
+			});
+			
+			IT("streamed value should be written straight to the value log", {
+				forest::LeafWriter writer = forest::make_leaf_writer();
+				string expected = "";
+				for(int i=0;i<10;i++){
+					writer->write(string(100, 'a' + i));
+					expected += string(100, 'a' + i);
+				}
+				forest::DetachedLeaf leaf = writer->finish();
+				EXPECT(forest::details::extract_leaf_val(leaf)->get_segment() >= 0).toBe(true);
+				forest::insert_leaf("vlog", "streamed", leaf);
+				EXPECT(read_leaf(forest::find_leaf("vlog", "streamed")->val())).toBe(expected);
+			});
+		});
+		
+		DESCRIBE("Add `vcache` tree with limited value cache", {
+			BEFORE_ALL({
+				forest::config_value_cache_bytes(1000);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "vcache", 5);
+				for(int i=0;i<100;i++){
+					forest::insert_leaf("vcache", "c"+std::to_string(1000+i), forest::make_leaf(string(50, 'a' + i%26)));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("vcache");
+				forest::config_value_cache_bytes(32 * 1024 * 1024);
+			});
+			
+			IT("cached values should not exceed the budget", {
+				for(int k=0;k<3;k++){
+					for(int i=0;i<100;i++){
+						EXPECT(read_leaf(forest::find_leaf("vcache", "c"+std::to_string(1000+i))->val())).toBe(string(50, 'a' + i%26));
+					}
+				}
+				EXPECT(forest::get_value_cache_bytes() <= 1000).toBe(true);
+			});
+			
+			IT("values larger than the budget should be saved and read back", {
+				for(int i=0;i<20;i++){
+					forest::update_leaf("vcache", "c"+std::to_string(1000+i), forest::make_leaf(string(2000, 'a' + i%26)));
+				}
+				for(int i=0;i<20;i++){
+					EXPECT(read_leaf(forest::find_leaf("vcache", "c"+std::to_string(1000+i))->val())).toBe(string(2000, 'a' + i%26));
+				}
+				EXPECT(forest::get_value_cache_bytes() <= 1000).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Check the thread pool", {
+			IT("pool utilization should be reported", {
+				double used = forest::get_pool_utilization();
+				EXPECT(used >= 0 && used <= 1).toBe(true);
+				EXPECT(forest::get_pool_queue_size() >= 0).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Check the metrics", {
+			IT("operations and caches should be counted", {
+				forest::Metrics m = forest::metrics();
+				EXPECT(m.insert.count > 0).toBe(true);
+				EXPECT(m.find.count > 0).toBe(true);
+				EXPECT(m.find.p50 <= m.find.p99).toBe(true);
+				EXPECT(m.find.p99 <= m.find.max).toBe(true);
+				EXPECT(m.leaf_cache_hits + m.leaf_cache_misses > 0).toBe(true);
+			});
+			
+			IT("metrics should be dumped as prometheus text", {
+				forest::string text = forest::metrics_text();
+				EXPECT(text.find("# TYPE forest_find_seconds summary") != forest::string::npos).toBe(true);
+				EXPECT(text.find("forest_cache_hits_total{cache=\"leaf\"}") != forest::string::npos).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Profile the locks", {
+			BEFORE_ALL({
+				forest::reset_lock_report();
+				forest::config_lock_profiling(true);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "profiled", 5);
+				for(int i=0;i<100;i++){
+					forest::insert_leaf("profiled", "l"+std::to_string(1000+i), forest::make_leaf(json_value(i, 2)));
+				}
+				for(int i=0;i<100;i++){
+					forest::find_leaf("profiled", "l"+std::to_string(1000+i));
+				}
+				forest::config_lock_profiling(false);
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("profiled");
+			});
+			
+			IT("locks should be ranked by the waiting time", {
+				std::vector<forest::LockStats> report = forest::lock_report();
+				EXPECT(report.size() > 0).toBe(true);
+				for(size_t i=1;i<report.size();i++){
+					EXPECT(report[i-1].wait_ns >= report[i].wait_ns).toBe(true);
+				}
+				EXPECT(forest::lock_report_text(5).find("travel") != forest::string::npos).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Check the disk scheduler", {
+			IT("node reads and delayed saves should be counted", {
+				forest::IOStats stats = forest::get_io_stats();
+				EXPECT(stats.reads > 0).toBe(true);
+				EXPECT(stats.delayed <= stats.writes).toBe(true);
+				EXPECT(stats.boosted <= stats.delayed).toBe(true);
+			});
+			
+			IT("read should be admitted ahead of a pending save", {
+				using IOScheduler = forest::details::IOScheduler;
+				forest::config_io_write_deadline_mks(10000000);
+				forest::IOStats before = forest::get_io_stats();
+				std::atomic<bool> saved = false;
+				
+				std::unique_ptr<IOScheduler::ticket> read(new IOScheduler::ticket(IOScheduler::IO_CLASS::READ));
+				{
+					IOScheduler::ticket write(IOScheduler::IO_CLASS::WRITE);
+					write.set_bytes(64 * 1024 * 1024);
+				}
+				std::thread saver([&saved]{
+					IOScheduler::ticket write(IOScheduler::IO_CLASS::WRITE);
+					saved = true;
+				});
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				EXPECT(saved.load()).toBe(false);
+				{
+					IOScheduler::ticket next(IOScheduler::IO_CLASS::READ);
+					EXPECT(saved.load()).toBe(false);
+				}
+				read = nullptr;
+				saver.join();
+				
+				forest::IOStats after = forest::get_io_stats();
+				EXPECT(saved.load()).toBe(true);
+				EXPECT(after.delayed > before.delayed).toBe(true);
+				EXPECT(after.boosted).toBe(before.boosted);
+				forest::config_io_write_deadline_mks(100000);
+			});
+			
+			IT("save should be boosted after its deadline", {
+				using IOScheduler = forest::details::IOScheduler;
+				forest::config_io_write_deadline_mks(20000);
+				forest::IOStats before = forest::get_io_stats();
+				
+				IOScheduler::ticket read(IOScheduler::IO_CLASS::READ);
+				{
+					IOScheduler::ticket write(IOScheduler::IO_CLASS::WRITE);
+					write.set_bytes(64 * 1024 * 1024);
+				}
+				auto start = std::chrono::steady_clock::now();
+				{
+					IOScheduler::ticket write(IOScheduler::IO_CLASS::WRITE);
+				}
+				auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+				
+				forest::IOStats after = forest::get_io_stats();
+				EXPECT(waited >= 20).toBe(true);
+				EXPECT(after.boosted > before.boosted).toBe(true);
+				forest::config_io_write_deadline_mks(100000);
+			});
+		});
+		
+		DESCRIBE("Add `based` tree and change it many times", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "based", 100);
+			});
+			
+			AFTER_ALL({
+				forest::config_save_schedule_mks(20000);
+				forest::cut_tree("based");
+			});
+			
+			IT("base should be queued once for many writes", {
+				forest::details::savior->flush();
+				forest::config_save_schedule_mks(1000000);
+				for(int i=0;i<50;i++){
+					forest::insert_leaf("based", "b"+std::to_string(1000+i), forest::make_leaf(json_value(i, 2)));
+				}
+				EXPECT((int)forest::details::savior->queued_writes("based")).toBe(1);
+			});
+			
+			IT("changes made once the base save began should be saved again", {
+				forest::details::savior->save("based", true);
+				EXPECT((int)forest::details::savior->queued_writes("based")).toBe(0);
+				
+				forest::insert_leaf("based", "b_after", forest::make_leaf(json_value(0, 2)));
+				EXPECT((int)forest::details::savior->queued_writes("based")).toBe(1);
+				
+				forest::details::savior->flush();
+				EXPECT((int)forest::details::savior->queued_writes("based")).toBe(0);
+				EXPECT((int)forest::details::extract_native_tree(forest::find_tree("based"))->get_stats().count).toBe(51);
+			});
+		});
+		
+		DESCRIBE("Add `rounds` tree and overfill the saving queue", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "rounds", 3);
+			});
+			
+			AFTER_ALL({
+				forest::config_save_schedule_mks(20000);
+				forest::cut_tree("rounds");
+			});
+			
+			IT("several items should be saved in one round", {
+				forest::details::savior->flush();
+				auto before = forest::details::savior->flush_stats();
+				
+				// Slow schedule lets the queue grow past its length between rounds
+				forest::config_save_schedule_mks(300000);
+				for(int i=0;i<300;i++){
+					forest::insert_leaf("rounds", "r"+std::to_string(1000+i), forest::make_leaf(json_value(i, 2)));
+				}
+				for(int i=0;i<1000 && forest::details::savior->save_queue_size();i++){
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+				
+				auto after = forest::details::savior->flush_stats();
+				EXPECT(forest::details::savior->save_queue_size()).toBe(0);
+				EXPECT(after.rounds > before.rounds).toBe(true);
+				EXPECT(after.items - before.items > after.rounds - before.rounds).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Add `stalled` tree and overrun the saves", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "stalled", 5);
+			});
+			
+			AFTER_ALL({
+				forest::config_reject_stalled_writes(false);
+				forest::config_save_watermarks(50000, 100000);
+				forest::cut_tree("stalled");
+			});
+			
+			IT("writes should be rejected above the high watermark", {
+				forest::config_save_watermarks(0, 1);
+				forest::config_reject_stalled_writes(true);
+				bool rejected = false;
+				for(int i=0;i<1000 && !rejected;i++){
+					try{
+						forest::insert_leaf("stalled", "s"+std::to_string(1000+i), forest::make_leaf(json_value(i, 2)));
+					} catch(forest::TreeException& e){
+						rejected = true;
+					}
+				}
+				EXPECT(rejected).toBe(true);
+				EXPECT(forest::get_stall_stats().rejected > 0).toBe(true);
+				EXPECT(forest::metrics().rejected_writes).toBe(forest::get_stall_stats().rejected);
+				EXPECT(forest::metrics_text().find("forest_rejected_writes_total") != forest::string::npos).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Add `packed` tree with compression", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "packed", 5, "", forest::COMPRESSION_TYPES::ZSTD);
+				for(int i=0;i<100;i++){
+					forest::insert_leaf("packed", "p"+std::to_string(1000+i), forest::make_leaf(json_value(i, i%3 ? 2 : 40)));
+				}
+				forest::insert_leaf("packed", "p_huge", forest::make_leaf(json_value(0, 5000)));
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("packed");
+			});
+			
+			IT("tree should keep the compression type", {
+				EXPECT((int)forest::find_tree("packed")->get_compression()).toBe((int)forest::COMPRESSION_TYPES::ZSTD);
+			});
+			
+			IT("small, packed and huge values should be read back", {
+				for(int k=0;k<2;k++){
+					for(int i=0;i<100;i++){
+						EXPECT(read_leaf(forest::find_leaf("packed", "p"+std::to_string(1000+i))->val())).toBe(json_value(i, i%3 ? 2 : 40));
+					}
+					EXPECT(read_leaf(forest::find_leaf("packed", "p_huge")->val())).toBe(json_value(0, 5000));
+				}
+			});
+		});
+		
+		DESCRIBE("Add `dict` tree with trained dictionary", {
+			BEFORE_ALL({
+				forest::config_dictionary_bytes(4096);
+				forest::config_value_cache_bytes(0);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "dict", 10, "", forest::COMPRESSION_TYPES::ZSTD);
+				for(int i=0;i<1000;i++){
+					forest::insert_leaf("dict", "d"+std::to_string(1000+i), forest::make_leaf(json_value(i, 2)));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("dict");
+				forest::config_value_cache_bytes(32 * 1024 * 1024);
+				forest::config_dictionary_bytes(16 * 1024);
+			});
+			
+			IT("dictionary should be trained from values of the tree", {
+				forest::train_dictionary("dict");
+				auto dicts = forest::details::extract_native_tree(forest::find_tree("dict"))->get_dictionaries();
+				EXPECT((int)dicts.size()).toBe(1);
+				EXPECT(file_exists("tmp/t1/_dict_" + std::to_string(dicts[0]))).toBe(true);
+				
+				for(int i=0;i<1000;i+=2){
+					forest::update_leaf("dict", "d"+std::to_string(1000+i), forest::make_leaf(json_value(i+1, 2)));
+				}
+				forest::details::savior->flush();
+				
+				// Values too small to be packed alone are packed with the dictionary
+				forest::details::uint_t raw = 0, stored = 0;
+				for(int i=0;i<1000;i+=2){
+					auto val = forest::details::extract_leaf_val(forest::find_leaf("dict", "d"+std::to_string(1000+i))->val());
+					raw += val->size();
+					stored += val->stored_size();
+				}
+				EXPECT(stored < raw).toBe(true);
+			});
+			
+			IT("values packed with and without dictionary should be read back", {
+				for(int i=0;i<1000;i++){
+					EXPECT(read_leaf(forest::find_leaf("dict", "d"+std::to_string(1000+i))->val())).toBe(json_value(i%2 ? i : i+1, 2));
+				}
+			});
+			
+			IT("tree without compression should not train dictionary", {
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "no_dict", 10);
+				EXPECT([](){ forest::train_dictionary("no_dict"); }).toThrowError();
+				forest::cut_tree("no_dict");
+			});
+			
+			IT("dictionary shared by trees should stay until the last of them is cut", {
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "dict_copy", 10, "", forest::COMPRESSION_TYPES::ZSTD);
+				for(int i=0;i<1000;i++){
+					forest::insert_leaf("dict_copy", "d"+std::to_string(1000+i), forest::make_leaf(json_value(i, 2)));
+				}
+				forest::train_dictionary("dict_copy");
+				forest::cut_tree("dict_copy");
+				for(int i=0;i<1000;i++){
+					EXPECT(read_leaf(forest::find_leaf("dict", "d"+std::to_string(1000+i))->val())).toBe(json_value(i%2 ? i : i+1, 2));
+				}
+			});
+		});
+		
+		DESCRIBE("Add `checked` tree with value checksums", {
+			BEFORE_ALL({
+				forest::config_value_checksums(true);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "checked", 5);
+				for(int i=0;i<200;i++){
+					forest::insert_leaf("checked", "k"+std::to_string(1000+i), forest::make_leaf(string(20 + i, 'a' + i%26)));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("checked");
+				forest::config_value_checksums(false);
+			});
+			
+			IT("values should be read back with checksums", {
+				for(int i=0;i<200;i++){
+					EXPECT(read_leaf(forest::find_leaf("checked", "k"+std::to_string(1000+i))->val())).toBe(string(20 + i, 'a' + i%26));
+				}
+			});
+			
+			IT("verification should not find corrupted files", {
+				forest::VerifyReport report = forest::verify("checked");
+				EXPECT((int)report.corrupted.size()).toBe(0);
+				EXPECT(report.nodes > 0).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Add `snap` tree and take a snapshot", {
+			static forest::Snapshot snap;
+			
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "snap", 5);
+				for(int i=0;i<100;i++){
+					forest::insert_leaf("snap", "k"+std::to_string(1000+i), forest::make_leaf("v"+std::to_string(i)));
+				}
+				snap = forest::snapshot("snap");
+				
+				// Change the tree after the snapshot
+				for(int i=0;i<100;i+=2){
+					forest::remove_leaf("snap", "k"+std::to_string(1000+i));
+				}
+				for(int i=1;i<100;i+=2){
+					forest::update_leaf("snap", "k"+std::to_string(1000+i), forest::make_leaf("new"));
+				}
+				for(int i=0;i<50;i++){
+					forest::insert_leaf("snap", "n"+std::to_string(1000+i), forest::make_leaf("new"));
+				}
+			});
+			
+			AFTER_ALL({
+				snap = nullptr;
+				forest::cut_tree("snap");
+			});
+			
+			IT("snapshot should find the values it was taken with", {
+				for(int i=0;i<100;i++){
+					EXPECT(read_leaf(snap->find("k"+std::to_string(1000+i)))).toBe("v"+std::to_string(i));
+				}
+				EXPECT([]{ snap->find("n1000"); }).toThrowError();
+			});
+			
+			IT("snapshot scan should return items in order", {
+				std::vector<string> keys;
+				snap->scan([&keys](const forest::LeafKey& key, forest::DetachedLeaf val){
+					keys.push_back(key);
+				});
+				EXPECT((int)keys.size()).toBe(100);
+				for(int i=0;i<100;i++){
+					EXPECT(keys[i]).toBe("k"+std::to_string(1000+i));
+				}
+			});
+			
+			IT("tree itself should have the new values", {
+				EXPECT(read_leaf(forest::find_leaf("snap", "k1001")->val())).toBe("new");
+				EXPECT(forest::find_leaf("snap", "k1000")->eof()).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Add `cas` tree and change leafs atomically", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "cas", 5);
+				forest::insert_leaf("cas", "state", forest::make_leaf("idle"));
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("cas");
+			});
+			
+			IT("cas_leaf should replace only the expected value", {
+				EXPECT(forest::cas_leaf("cas", "state", forest::make_leaf("busy"), forest::make_leaf("done"))).toBe(false);
+				EXPECT(read_leaf(forest::find_leaf("cas", "state")->val())).toBe("idle");
+				EXPECT(forest::cas_leaf("cas", "state", forest::make_leaf("idle"), forest::make_leaf("busy"))).toBe(true);
+				EXPECT(read_leaf(forest::find_leaf("cas", "state")->val())).toBe("busy");
+			});
+			
+			IT("cas_leaf should insert and remove with null leafs", {
+				EXPECT(forest::cas_leaf("cas", "state", nullptr, forest::make_leaf("idle"))).toBe(false);
+				EXPECT(forest::cas_leaf("cas", "lock", nullptr, forest::make_leaf("owner"))).toBe(true);
+				EXPECT(read_leaf(forest::find_leaf("cas", "lock")->val())).toBe("owner");
+				EXPECT(forest::cas_leaf("cas", "lock", forest::make_leaf("owner"), nullptr)).toBe(true);
+				EXPECT(forest::find_leaf("cas", "lock")->eof()).toBe(true);
+			});
+			
+			IT("merge_leaf should build the value from the current one", {
+				auto inc = [](forest::DetachedLeaf cur){
+					int count = cur ? std::stoi(read_leaf(cur)) : 0;
+					return forest::make_leaf(std::to_string(count + 1));
+				};
+				for(int i=0;i<10;i++){
+					forest::merge_leaf("cas", "counter", inc);
+				}
+				EXPECT(read_leaf(forest::merge_leaf("cas", "counter", inc))).toBe("11");
+				
+				forest::merge_leaf("cas", "counter", [](forest::DetachedLeaf cur){
+					return forest::DetachedLeaf(nullptr);
+				});
+				EXPECT(forest::find_leaf("cas", "counter")->eof()).toBe(true);
+			});
+			
+			IT("merge_leaf should be called again if its callback changed the key", {
+				int calls = 0;
+				forest::insert_leaf("cas", "merged", forest::make_leaf("1"));
+				forest::DetachedLeaf res = forest::merge_leaf("cas", "merged", [&calls](forest::DetachedLeaf cur){
+					if(calls++ == 0){
+						forest::update_leaf("cas", "merged", forest::make_leaf("5"));
+					}
+					return forest::make_leaf(std::to_string(std::stoi(read_leaf(cur)) + 1));
+				});
+				EXPECT(calls).toBe(2);
+				EXPECT(read_leaf(res)).toBe("6");
+				EXPECT(read_leaf(forest::find_leaf("cas", "merged")->val())).toBe("6");
+			});
+		});
+		
+		DESCRIBE("Add `deltas` tree and merge deltas", {
+			BEFORE_ALL({
+				forest::register_merge_operator("append", [](const string* val, const string& delta){
+					return val ? *val + "," + delta : delta;
+				});
+				forest::register_merge_operator("add", [](const string* val, const string& delta){
+					return std::to_string((val ? std::stoi(*val) : 0) + std::stoi(delta));
+				});
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "deltas", 5);
+				for(int i=0;i<100;i++){
+					forest::merge_delta("deltas", "list", "append", std::to_string(i));
+				}
+				for(int i=0;i<200;i++){
+					forest::merge_delta("deltas", "counter", "add", "1");
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("deltas");
+			});
+			
+			IT("deltas should be merged on read", {
+				string list = "0";
+				for(int i=1;i<100;i++){
+					list += "," + std::to_string(i);
+				}
+				EXPECT(read_leaf(forest::find_leaf("deltas", "list")->val())).toBe(list);
+				EXPECT(read_leaf(forest::find_leaf("deltas", "counter")->val())).toBe("200");
+			});
+			
+			IT("merged values should be saved", {
+				forest::merge_delta("deltas", "counter", "add", "5");
+				forest::fold();
+				forest::bloom("tmp/t1");
+				EXPECT(read_leaf(forest::find_leaf("deltas", "counter")->val())).toBe("205");
+			});
+			
+			IT("deltas should not be merged until the value is read", {
+				static int calls = 0;
+				forest::register_merge_operator("count", [](const string* val, const string& delta){
+					++calls;
+					return delta;
+				});
+				for(int i=0;i<10;i++){
+					forest::merge_delta("deltas", "lazy", "count", std::to_string(i));
+				}
+				EXPECT(calls).toBe(0);
+				EXPECT(read_leaf(forest::find_leaf("deltas", "lazy")->val())).toBe("9");
+				EXPECT(calls).toBe(10);
+			});
+			
+			IT("unknown merge operator should throw", {
+				EXPECT([]{ forest::merge_delta("deltas", "counter", "unknown", "1"); }).toThrowError();
+			});
+		});
+		
+		DESCRIBE("Add `accounts` and `history` trees and run transactions", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "accounts", 5);
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "history", 5);
+				for(int i=0;i<10;i++){
+					forest::insert_leaf("accounts", "k"+std::to_string(i), forest::make_leaf("100"));
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("accounts");
+				forest::cut_tree("history");
+			});
+			
+			IT("transaction should change both trees on commit", {
+				forest::Tree accounts = forest::find_tree("accounts");
+				forest::Tree history = forest::find_tree("history");
+				forest::Transaction tx = forest::begin_transaction();
+				EXPECT(read_leaf(tx->find(accounts, "k0"))).toBe("100");
+				tx->update(accounts, "k0", forest::make_leaf("90"));
+				tx->insert(history, "h0", forest::make_leaf("-10"));
+				tx->remove(accounts, "k9");
+				
+				EXPECT(read_leaf(tx->find(accounts, "k0"))).toBe("90");
+				EXPECT(read_leaf(forest::find_leaf("accounts", "k0")->val())).toBe("100");
+				EXPECT(forest::find_leaf("history", "h0")->eof()).toBe(true);
+				
+				EXPECT(tx->commit()).toBe(true);
+				EXPECT(read_leaf(forest::find_leaf("accounts", "k0")->val())).toBe("90");
+				EXPECT(read_leaf(forest::find_leaf("history", "h0")->val())).toBe("-10");
+				EXPECT(forest::find_leaf("accounts", "k9")->eof()).toBe(true);
+			});
+			
+			IT("transaction should not commit if the value it read was changed", {
+				forest::Tree accounts = forest::find_tree("accounts");
+				forest::Transaction tx = forest::begin_transaction();
+				EXPECT(read_leaf(tx->find(accounts, "k1"))).toBe("100");
+				forest::update_leaf("accounts", "k1", forest::make_leaf("50"));
+				tx->update(accounts, "k1", forest::make_leaf("1"));
+				tx->insert(accounts, "k2", forest::make_leaf("1"));
+				
+				EXPECT(tx->commit()).toBe(false);
+				EXPECT(read_leaf(forest::find_leaf("accounts", "k1")->val())).toBe("50");
+				EXPECT(read_leaf(forest::find_leaf("accounts", "k2")->val())).toBe("100");
+			});
+			
+			IT("transaction should be committed only once", {
+				forest::Transaction tx = forest::begin_transaction();
+				EXPECT(tx->commit()).toBe(true);
+				EXPECT([&tx]{ tx->commit(); }).toThrowError();
+			});
+		});
+		
+		DESCRIBE("Add `txlog` tree and interrupt the transaction", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "txlog", 5);
+				forest::insert_leaf("txlog", "a", forest::make_leaf("old"));
+				
+				forest::Tree tree = forest::find_tree("txlog");
+				forest::Transaction tx = forest::begin_transaction();
+				tx->update(tree, "a", forest::make_leaf("new"));
+				tx->insert(tree, "b", forest::make_leaf("new"));
+				tx->commit();
+				string record = read_file("tmp/t1/_transactions");
+				tx = nullptr;
+				tree = nullptr;
+				
+				// Pretend the nodes were saved before the transaction when the process died
+				forest::update_leaf("txlog", "a", forest::make_leaf("old"));
+				forest::remove_leaf("txlog", "b");
+				forest::fold();
+				write_file("tmp/t1/_transactions", record + "T 1\nW 3");
+				
+				forest::bloom("tmp/t1");
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("txlog");
+			});
+			
+			IT("logged transaction should be replayed", {
+				EXPECT(read_leaf(forest::find_leaf("txlog", "a")->val())).toBe("new");
+				EXPECT(read_leaf(forest::find_leaf("txlog", "b")->val())).toBe("new");
+			});
+			
+			IT("replayed transaction should be kept in the log until fold", {
+				EXPECT(read_file("tmp/t1/_transactions").size() > 0).toBe(true);
+			});
+		});
+		
+		DESCRIBE("Add `txaba` tree and interrupt after the value is written back", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "txaba", 5);
+				forest::insert_leaf("txaba", "a", forest::make_leaf("A"));
+				
+				forest::Tree tree = forest::find_tree("txaba");
+				forest::Transaction tx = forest::begin_transaction();
+				tx->update(tree, "a", forest::make_leaf("B"));
+				tx->commit();
+				tx = nullptr;
+				tree = nullptr;
+				
+				// Value is written back and saved before the process dies
+				forest::update_leaf("txaba", "a", forest::make_leaf("A"));
+				string record = read_file("tmp/t1/_transactions");
+				forest::fold();
+				write_file("tmp/t1/_transactions", record);
+				
+				forest::bloom("tmp/t1");
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("txaba");
+			});
+			
+			IT("later write of the key should be replayed after the transaction", {
+				EXPECT(read_leaf(forest::find_leaf("txaba", "a")->val())).toBe("A");
+			});
+		});
+		
+		DESCRIBE("Add `txcheckpoint` tree and commit transactions over the log limit", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "txcheckpoint", 5);
+				forest::Tree tree = forest::find_tree("txcheckpoint");
+				string val(64 * 1024, 'v');
+				for(int i=0;i<80;i++){
+					forest::Transaction tx = forest::begin_transaction();
+					tx->insert(tree, "k" + std::to_string(i), forest::make_leaf(val));
+					tx->commit();
+				}
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("txcheckpoint");
+			});
+			
+			IT("log should be cut off after the checkpoint", {
+				for(int i=0;i<500 && read_file("tmp/t1/_transactions").size() >= 4 * 1024 * 1024;i++){
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+				EXPECT(read_file("tmp/t1/_transactions").size() < 4 * 1024 * 1024).toBe(true);
+			});
+			
+			IT("values should be kept after the checkpoint", {
+				EXPECT(read_leaf(forest::find_leaf("txcheckpoint", "k79")->val()).size()).toBe(64 * 1024);
+			});
+		});
+		
+		DESCRIBE("Add `journaled` tree and interrupt the root update", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "journaled", 5);
+				for(int i=0;i<100;i++){
+					forest::insert_leaf("journaled", "k"+std::to_string(1000+i), forest::make_leaf("v"+std::to_string(i)));
+				}
+				forest::fold();
+				
+				// Pretend the root base was being replaced when the process died
+				write_file("tmp/t1/_jb", read_file("tmp/t1/_root"));
+				write_file("tmp/t1/_root", "broken");
+				write_file("tmp/t1/_jc", "stale");
+				write_file("tmp/t1/_journal", "R 1\n_root\n_jb\n\nR 2\n_other\n_jc\n\nC 2\n");
+				
+				forest::bloom("tmp/t1");
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("journaled");
+			});
+			
+			IT("uncommitted root update should be rolled back", {
+				EXPECT(file_exists("tmp/t1/_jb")).toBe(false);
+				for(int i=0;i<100;i++){
+					EXPECT(read_leaf(forest::find_leaf("journaled", "k"+std::to_string(1000+i))->val())).toBe("v"+std::to_string(i));
+				}
+			});
+			
+			IT("previous version of the committed group should be removed", {
+				EXPECT(file_exists("tmp/t1/_jc")).toBe(false);
+			});
+		});
+		
+		DESCRIBE("Add `joined` tree and interrupt joined groups", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "joined", 5);
+				for(int i=0;i<100;i++){
+					forest::insert_leaf("joined", "k"+std::to_string(1000+i), forest::make_leaf("v"+std::to_string(i)));
+				}
+				forest::fold();
+				
+				// Group 2 replaced the root written by the open group 1 and committed
+				write_file("tmp/t1/_jb1", read_file("tmp/t1/_root"));
+				write_file("tmp/t1/_jb2", "broken by group 1");
+				write_file("tmp/t1/_root", "broken by group 2");
+				write_file("tmp/t1/_journal", "R 1\n_root\n_jb1\n\nJ 2 1\nR 2\n_root\n_jb2\n\nC 2\n");
+				
+				forest::bloom("tmp/t1");
+			});
+			
+			AFTER_ALL({
+				forest::cut_tree("joined");
+			});
+			
+			IT("committed group joined with the open one should be rolled back too", {
+				EXPECT(file_exists("tmp/t1/_jb1")).toBe(false);
+				EXPECT(file_exists("tmp/t1/_jb2")).toBe(false);
+				for(int i=0;i<100;i++){
+					EXPECT(read_leaf(forest::find_leaf("joined", "k"+std::to_string(1000+i))->val())).toBe("v"+std::to_string(i));
+				}
+			});
+		});
+		
+		DESCRIBE("Add `warm tree` tree and bloom with cache warming", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "warm tree", 5);
+				for(int i=0;i<200;i++){
+					forest::insert_leaf("warm tree", "k"+std::to_string(1000+i), forest::make_leaf("v"+std::to_string(i)));
+				}
+				forest::config_warm_cache(true);
+				forest::fold();
+				forest::bloom("tmp/t1");
+			});
+			
+			AFTER_ALL({
+				forest::config_warm_cache(false);
+				forest::cut_tree("warm tree");
+			});
+			
+			IT("manifest of hot nodes should be written on fold", {
+				EXPECT(file_exists("tmp/t1/_warm")).toBe(true);
+			});
+			
+			IT("tree name with spaces should be kept in the manifest", {
+				EXPECT(read_file("tmp/t1/_warm").find("9 warm tree ") != string::npos).toBe(true);
+			});
+			
+			IT("items should be read while caches are warmed", {
+				for(int i=0;i<200;i++){
+					EXPECT(read_leaf(forest::find_leaf("warm tree", "k"+std::to_string(1000+i))->val())).toBe("v"+std::to_string(i));
+				}
+			});
+			
+			IT("warming should finish in background", {
+				while(forest::warms()){
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				EXPECT(forest::warms()).toBe(false);
+			});
+		});
+		
+		DESCRIBE("Add `cold tree` tree, remove its keys and bloom with cache warming", {
+			BEFORE_ALL({
+				forest::plant_tree(forest::TREE_TYPES::KEY_STRING, "cold tree", 5);
+				for(int i=0;i<200;i++){
+					forest::insert_leaf("cold tree", "k"+std::to_string(1000+i), forest::make_leaf("v"+std::to_string(i)));
+				}
+				for(int i=0;i<200;i++){
+					if(i % 4){
+						forest::remove_leaf("cold tree", "k"+std::to_string(1000+i));
+					}
+				}
+				forest::config_warm_cache(true);
+				forest::fold();
+				
+				// Tree removed after the manifest was written is still named in the root tree entry
+				string manifest = read_file("tmp/t1/_warm");
+				size_t nl = manifest.find('\n');
+				manifest = std::to_string(std::stoi(manifest.substr(0, nl)) + 1) + manifest.substr(nl) + "5 _root 1\n9 gone tree\n";
+				write_file("tmp/t1/_warm", manifest);
+				forest::bloom("tmp/t1");
+			});
+			
+			AFTER_ALL({
+				forest::config_warm_cache(false);
+				forest::cut_tree("cold tree");
+			});
+			
+			IT("warming should skip removed keys and trees", {
+				while(forest::warms()){
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				EXPECT(forest::warms()).toBe(false);
+				EXPECT(read_leaf(forest::find_leaf("cold tree", "k1004")->val())).toBe("v4");
+				EXPECT(forest::find_leaf("cold tree", "k1005")->eof()).toBe(true);
+			});
+		});
+		
 		DESCRIBE("Add 20 trees with annotations", {
 			BEFORE_ALL({
 				for(int i=0;i<20;i++){